@@ -0,0 +1,84 @@
+// Frame update cost of an animated sphere cloud: a full BVH rebuild every
+// frame, refitting only, and Scene::update, which refits and rebuilds once
+// the SAH cost degrades past the threshold. A share of the spheres takes a
+// random walk step each frame; trace throughput shows the tree quality.
+#include "common.hpp"
+
+#include "neon/rendable.hpp"
+#include "neon/scene.hpp"
+#include "neon/sphere.hpp"
+#include "neon/utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+enum class Mode { Rebuild, Refit, Update };
+
+void run(const char *name, Mode mode, int count, float share, int frames) {
+  std::mt19937 gen(1234u);
+  const float cubeSize = bench::cubeSize(count);
+  std::vector<ne::RendablePointer> spheres;
+  auto scene = bench::randomSpheres(count, cubeSize, gen, &spheres);
+  if (mode == Mode::Refit)
+    scene->setRebuildThreshold(std::numeric_limits<float>::max());
+  scene->build();
+  const float initialSah = scene->sahCost();
+  const std::vector<ne::Ray> rays = bench::randomRays(50000, cubeSize, gen);
+
+  // the moving spheres drift a few radii per frame
+  const int moving = std::max(1, int(count * share));
+  std::normal_distribution<float> step(0.0f, 1.0f);
+  std::uniform_int_distribution<int> pick(0, count - 1);
+  double updateMs = 0.0, rate = 0.0;
+  int rebuilds = 0;
+  for (int f = 0; f < frames; ++f) {
+    std::vector<std::pair<ne::RendablePointer, glm::vec3>> moves;
+    for (int i = 0; i < moving; ++i) {
+      const ne::RendablePointer &object = spheres[pick(gen)];
+      const auto *sphere = static_cast<const ne::Sphere *>(object.get());
+      moves.emplace_back(object, sphere->center_ +
+                                     glm::vec3(step(gen), step(gen), step(gen)));
+    }
+
+    ne::utils::Timer timer(true);
+    if (mode == Mode::Rebuild) {
+      for (const auto &move : moves)
+        static_cast<ne::Sphere *>(move.first.get())->center_ = move.second;
+      scene->build();
+      ++rebuilds;
+    } else {
+      for (const auto &move : moves)
+        scene->setPosition(move.first, move.second);
+      rebuilds += scene->update() ? 1 : 0;
+    }
+    timer.stop();
+    updateMs += timer.count<std::chrono::microseconds>() * 1e-3;
+    rate += bench::trace(*scene, rays);
+  }
+
+  std::printf("%10d %7.1f%% %8s %12.3f %9d %10.2f %10.2f %12.3f\n", count,
+              100.0f * share, name, updateMs / frames, rebuilds, initialSah,
+              scene->sahCost(), rate / frames * 1e-6);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int frames = 60;
+  std::printf("%10s %8s %8s %12s %9s %10s %10s %12s\n", "spheres", "moving",
+              "mode", "frame(ms)", "rebuilds", "sah start", "sah end",
+              "trace(Mr/s)");
+  for (int count : {10000, 100000}) {
+    for (float share : {0.001f, 0.01f, 0.1f}) {
+      run("rebuild", Mode::Rebuild, count, share, frames);
+      run("refit", Mode::Refit, count, share, frames);
+      run("update", Mode::Update, count, share, frames);
+    }
+  }
+  return 0;
+}
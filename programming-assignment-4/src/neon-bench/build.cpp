@@ -0,0 +1,84 @@
+// Build time and quality of the BVH builders: binned SAH and LBVH (Morton
+// codes), each on one thread and on all of them. Trace throughput through
+// Scene shows what the SAH cost difference means for rendering.
+// Usage: neon-bench-build [threads]
+#include "common.hpp"
+
+#include "neon/bvh.hpp"
+#include "neon/scene.hpp"
+#include "neon/utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  const unsigned numThreads =
+      argc > 1 ? unsigned(std::max(1, std::stoi(argv[1])))
+               : std::max(1u, std::thread::hardware_concurrency());
+  const int counts[] = {1000, 10000, 100000, 1000000};
+  const int numRays = 200000;
+
+  struct Config {
+    const char *name;
+    ne::BvhBuilder builder;
+    unsigned threads;
+  };
+  const Config configs[] = {
+      {"sah", ne::BvhBuilder::BinnedSah, 1},
+      {"sah", ne::BvhBuilder::BinnedSah, numThreads},
+      {"morton", ne::BvhBuilder::Morton, 1},
+      {"morton", ne::BvhBuilder::Morton, numThreads},
+  };
+
+  std::printf("%10s %8s %8s %12s %10s %12s\n", "spheres", "builder", "threads",
+              "build(ms)", "sah", "trace(Mr/s)");
+
+  for (int count : counts) {
+    std::mt19937 gen(1234u);
+    const float cubeSize = bench::cubeSize(count);
+    auto scene = bench::randomSpheres(count, cubeSize, gen);
+    const std::vector<ne::Ray> rays =
+        bench::randomRays(numRays, cubeSize, gen);
+
+    std::vector<ne::AABB> bounds;
+    bounds.reserve(count);
+    std::uniform_real_distribution<float> pos(0.0f, cubeSize);
+    std::uniform_real_distribution<float> rad(0.2f, 1.0f);
+    for (int i = 0; i < count; ++i) {
+      const glm::vec3 c(pos(gen), pos(gen), pos(gen));
+      const float r = rad(gen);
+      bounds.emplace_back(c - glm::vec3(r), c + glm::vec3(r));
+    }
+
+    int referenceHits = -1;
+    for (const Config &config : configs) {
+      // best of a few builds
+      ne::BVH bvh;
+      long long best = -1;
+      for (int r = 0; r < 3; ++r) {
+        ne::utils::Timer timer(true);
+        bvh.build(bounds, 4, config.builder, config.threads);
+        timer.stop();
+        const long long us = timer.count<std::chrono::microseconds>();
+        best = best < 0 ? us : std::min(best, us);
+      }
+
+      scene->setBvhBuilder(config.builder, config.threads);
+      scene->build();
+      int hits;
+      const double rate = bench::trace(*scene, rays, hits);
+      if (referenceHits >= 0 && hits != referenceHits)
+        std::fprintf(stderr, "hit count mismatch: %d, expected %d\n", hits,
+                     referenceHits);
+      referenceHits = hits;
+
+      std::printf("%10d %8s %8u %12.2f %10.2f %12.3f\n", count, config.name,
+                  config.threads, best * 1e-3, bvh.sahCost(), rate * 1e-6);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Throughput of Scene::rayIntersect with and without the BVH as the number
+// of spheres grows, for the binary BVH and the quantized 8 wide one. Checks
+// that both reach the same primitives for rays lying on box faces.
+#include "common.hpp"
+
+#include "neon/aabb.hpp"
+#include "neon/bvh.hpp"
+#include "neon/bvh8.hpp"
+#include "neon/scene.hpp"
+#include "neon/utils.hpp"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+// number of primitives of bounds the ray overlaps, as reached through tree
+template <typename Tree>
+int reached(const Tree &tree, const std::vector<uint32_t> &indices,
+            const std::vector<ne::AABB> &bounds, ne::Ray ray) {
+  const glm::vec3 invDir = 1.0f / ray.dir;
+  int count = 0;
+  tree.intersect(ray, [&](uint32_t first, uint32_t n, ne::Ray &r) {
+    for (uint32_t i = first; i < first + n; ++i) {
+      float tNear;
+      count += bounds[indices[i]].hit(r.o, invDir, r.t, tNear) ? 1 : 0;
+    }
+    return false;
+  });
+  return count;
+}
+
+// Rays starting on the faces of a grid of unit boxes and running parallel to
+// them give NaN slabs, which must not limit them. Returns the rays for which
+// the BVH8 reaches other primitives than the binary BVH.
+int checkSlabPlanes() {
+  const int n = 8;
+  std::vector<ne::AABB> bounds;
+  for (int i = 0; i < n; ++i)
+    for (int j = 0; j < n; ++j)
+      for (int k = 0; k < n; ++k)
+        bounds.emplace_back(glm::vec3(i, j, k), glm::vec3(i + 1, j + 1, k + 1));
+
+  ne::BVH binary, collapsed;
+  binary.build(bounds);
+  collapsed.build(bounds);
+  ne::BVH8 wide;
+  if (!wide.build(collapsed)) {
+    std::fprintf(stderr, "slab planes: BVH8 build failed\n");
+    return 1;
+  }
+
+  int rays = 0, mismatches = 0;
+  for (int a = 0; a < 3; ++a) {
+    const int b = (a + 1) % 3, c = (a + 2) % 3;
+    for (int plane = 0; plane <= n; ++plane)
+      for (int u = 0; u <= 2 * n; ++u)
+        for (const glm::vec2 d : {glm::vec2(0, 1), glm::vec2(1, 1),
+                                  glm::vec2(-1, 1), glm::vec2(1, 0)}) {
+          glm::vec3 o(0.0f), dir(0.0f);
+          o[a] = float(plane);
+          o[b] = 0.5f * u;
+          o[c] = -1.0f;
+          dir[b] = d.x;
+          dir[c] = d.y;
+          if (d.y == 0.0f)
+            o[c] = 0.5f * n; // along b through the middle of the grid
+          const ne::Ray ray(o, dir);
+          ++rays;
+          if (reached(binary, binary.indices(), bounds, ray) !=
+              reached(wide, collapsed.indices(), bounds, ray))
+            ++mismatches;
+        }
+  }
+  if (mismatches > 0)
+    std::fprintf(stderr, "slab planes: %d of %d rays reach other primitives "
+                         "through the BVH8\n",
+                 mismatches, rays);
+  return mismatches;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int slabMismatches = checkSlabPlanes();
+
+  const int counts[] = {10, 100, 1000, 10000, 100000, 1000000};
+  const int numRays = 200000;
+  // linear scan is O(rays * spheres), keep it bounded
+  const int maxLinearWork = 200000000;
+
+  std::printf("%10s %12s %12s %14s %14s %10s %14s %10s %10s\n", "spheres",
+              "build(ms)", "sah", "linear(Mr/s)", "bvh(Mr/s)", "speedup",
+              "bvh8(Mr/s)", "speedup", "memory");
+
+  for (int count : counts) {
+    std::mt19937 gen(1234u);
+    const float cubeSize = bench::cubeSize(count);
+    auto scene = bench::randomSpheres(count, cubeSize, gen);
+    const std::vector<ne::Ray> rays =
+        bench::randomRays(numRays, cubeSize, gen);
+
+    double linear = 0.0;
+    int linearHits = -1;
+    if (double(count) * numRays <= maxLinearWork)
+      linear = bench::trace(*scene, rays, linearHits);
+
+    ne::utils::Timer buildTimer(true);
+    scene->build();
+    buildTimer.stop();
+
+    int bvhHits;
+    const double bvh = bench::trace(*scene, rays, bvhHits);
+    const size_t bvhMemory = scene->bvhMemory();
+
+    scene->setWideBvh(true);
+    scene->build();
+    int wideHits;
+    const double wide = bench::trace(*scene, rays, wideHits);
+
+    if (linearHits >= 0 && linearHits != bvhHits)
+      std::fprintf(stderr, "hit count mismatch: linear %d, bvh %d\n",
+                   linearHits, bvhHits);
+    if (wideHits != bvhHits)
+      std::fprintf(stderr, "hit count mismatch: bvh %d, bvh8 %d\n", bvhHits,
+                   wideHits);
+
+    char linearText[32] = "-";
+    char speedupText[32] = "-";
+    if (linearHits >= 0) {
+      std::snprintf(linearText, sizeof(linearText), "%.3f", linear * 1e-6);
+      std::snprintf(speedupText, sizeof(speedupText), "%.1fx", bvh / linear);
+    }
+    std::printf("%10d %12lld %12.2f %14s %14.3f %10s %14.3f %9.2fx %9.1f%%\n",
+                count, (long long)buildTimer.count(), scene->sahCost(),
+                linearText, bvh * 1e-6, speedupText, wide * 1e-6, wide / bvh,
+                100.0 * scene->bvhMemory() / std::max<size_t>(bvhMemory, 1));
+  }
+  return slabMismatches > 0 ? 1 : 0;
+}
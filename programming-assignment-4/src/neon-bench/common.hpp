@@ -0,0 +1,106 @@
+// Workloads shared by the benchmarks: random sphere clouds, random rays and a
+// timed trace loop, so every bench measures the same thing the same way.
+#ifndef __BENCH_COMMON_H_
+#define __BENCH_COMMON_H_
+
+#include "neon/intersection.hpp"
+#include "neon/material.hpp"
+#include "neon/ray.hpp"
+#include "neon/scene.hpp"
+#include "neon/sphere.hpp"
+#include "neon/utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace bench {
+
+/// Side of the cube randomSpheres spreads count spheres over. The volume
+/// grows with the count, so the number of spheres along a ray stays roughly
+/// the same for every size.
+inline float cubeSize(int count) { return 4.0f * std::cbrt(float(count)); }
+
+/// Unbuilt scene of count spheres of radius 0.2 to 1 with centers in
+/// [0, cubeSize]^3. spheres, if given, receives them in insertion order.
+inline std::shared_ptr<ne::Scene>
+randomSpheres(int count, float cubeSize, std::mt19937 &gen,
+              std::vector<ne::RendablePointer> *spheres = nullptr) {
+  const ne::MaterialPointer material =
+      std::make_shared<ne::Lambertian>(glm::vec3(0.5f));
+  std::uniform_real_distribution<float> pos(0.0f, cubeSize);
+  std::uniform_real_distribution<float> rad(0.2f, 1.0f);
+
+  auto scene = std::make_shared<ne::Scene>();
+  for (int i = 0; i < count; ++i) {
+    auto sphere = std::make_shared<ne::Sphere>(
+        glm::vec3(pos(gen), pos(gen), pos(gen)), rad(gen), material);
+    scene->add(sphere);
+    if (spheres)
+      spheres->push_back(sphere);
+  }
+  return scene;
+}
+
+/// rays from random points in [0, cubeSize]^3 in random directions
+inline std::vector<ne::Ray> randomRays(int count, float cubeSize,
+                                       std::mt19937 &gen) {
+  std::uniform_real_distribution<float> pos(0.0f, cubeSize);
+  std::normal_distribution<float> dir(0.0f, 1.0f);
+  std::vector<ne::Ray> rays;
+  rays.reserve(count);
+  for (int i = 0; i < count; ++i)
+    rays.emplace_back(glm::vec3(pos(gen), pos(gen), pos(gen)),
+                      glm::vec3(dir(gen), dir(gen), dir(gen)));
+  return rays;
+}
+
+/// rays from one origin in random directions
+inline std::vector<ne::Ray> randomRays(const glm::vec3 &origin, size_t count,
+                                       std::mt19937 &gen) {
+  std::normal_distribution<float> dir(0.0f, 1.0f);
+  std::vector<ne::Ray> rays;
+  rays.reserve(count);
+  for (size_t i = 0; i < count; ++i)
+    rays.emplace_back(origin, glm::vec3(dir(gen), dir(gen), dir(gen)));
+  return rays;
+}
+
+/// Traces every ray through the scene and returns rays per second.
+/// record(i, found, ray, hit) receives the result of ray i inside the timed
+/// loop, so keep it cheap.
+template <typename Record>
+double trace(const ne::Scene &scene, const std::vector<ne::Ray> &rays,
+             Record &&record) {
+  ne::utils::Timer timer(true);
+  for (size_t i = 0; i < rays.size(); ++i) {
+    ne::Ray ray = rays[i];
+    ne::Intersection hit;
+    const bool found = scene.rayIntersect(ray, hit);
+    record(i, found, ray, hit);
+  }
+  timer.stop();
+  const double sec = timer.count<std::chrono::microseconds>() * 1e-6;
+  return rays.size() / std::max(sec, 1e-9);
+}
+
+inline double trace(const ne::Scene &scene, const std::vector<ne::Ray> &rays) {
+  return trace(scene, rays,
+               [](size_t, bool, const ne::Ray &, const ne::Intersection &) {});
+}
+
+/// hits receives the number of rays that hit something
+inline double trace(const ne::Scene &scene, const std::vector<ne::Ray> &rays,
+                    int &hits) {
+  hits = 0;
+  return trace(scene, rays,
+               [&hits](size_t, bool found, const ne::Ray &,
+                       const ne::Intersection &) { hits += found ? 1 : 0; });
+}
+
+} // namespace bench
+
+#endif // __BENCH_COMMON_H_
@@ -0,0 +1,63 @@
+// Throughput of ne::Denoiser on a synthetic noisy frame: smooth shading
+// plus noise, blocky albedo and normal guides. Runs on one thread and on all
+// of them.
+// Usage: neon-bench-denoise [width height]
+#include "neon/denoiser.hpp"
+#include "neon/film.hpp"
+#include "neon/utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+
+int main(int argc, char *argv[]) {
+  const glm::uvec2 size =
+      argc > 2 ? glm::uvec2(std::max(1, std::stoi(argv[1])),
+                            std::max(1, std::stoi(argv[2])))
+               : glm::uvec2(1920, 1080);
+  const unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  ne::Film color(size), albedo(size), normal(size), output;
+  std::mt19937 gen(1234u);
+  std::normal_distribution<float> noise(0.0f, 0.2f);
+  for (unsigned int y = 0; y < size.y; ++y) {
+    for (unsigned int x = 0; x < size.x; ++x) {
+      const glm::uvec2 index(x, y);
+      // 64 pixel blocks of different material and orientation
+      const unsigned int block = (x / 64 + y / 64) % 4;
+      const glm::vec3 a(0.2f + 0.2f * block, 0.5f, 0.8f - 0.2f * block);
+      const glm::vec3 n =
+          glm::normalize(glm::vec3(float(block) - 1.5f, 1.0f, 0.5f));
+      const float shading =
+          0.5f + 0.5f * std::sin(x * 0.01f) * std::cos(y * 0.01f);
+      const glm::vec3 e(noise(gen), noise(gen), noise(gen));
+      color.add(index, a * shading + e);
+      albedo.add(index, a);
+      normal.add(index, n);
+    }
+  }
+
+  std::printf("%12s %8s %12s %12s\n", "pixels", "threads", "time(ms)",
+              "Mpixel/s");
+  for (unsigned threads : {1u, numThreads}) {
+    ne::Denoiser denoiser;
+    // best of a few runs
+    long long best = -1;
+    for (int r = 0; r < 5; ++r) {
+      ne::utils::Timer timer(true);
+      denoiser.denoise(color, albedo, normal, output, threads);
+      timer.stop();
+      const long long us = timer.count<std::chrono::microseconds>();
+      best = best < 0 ? us : std::min(best, us);
+    }
+    const double rate = color.numPixels() / std::max(best * 1e-6, 1e-9);
+    std::printf("%12u %8u %12.2f %12.2f\n", color.numPixels(), threads,
+                best * 1e-3, rate * 1e-6);
+    if (numThreads == 1)
+      break;
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+// Direct lighting cost per shading point as the number of lights grows,
+// sampling every light versus picking lights from the light BVH. Both
+// estimate the same light, so the means agree up to noise; the relative
+// deviation of a single estimate shows what the light BVH pays in noise.
+#include "neon/intersection.hpp"
+#include "neon/material.hpp"
+#include "neon/sampler.hpp"
+#include "neon/scene.hpp"
+#include "neon/sphere.hpp"
+#include "neon/utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// floor with small lights hovering over it
+std::shared_ptr<ne::Scene> lightField(int numLights, bool lightBvh) {
+  const ne::MaterialPointer ground =
+      std::make_shared<ne::Lambertian>(glm::vec3(0.8f));
+  const ne::MaterialPointer light = std::make_shared<ne::DiffuseLight>();
+  auto scene = std::make_shared<ne::Scene>();
+  scene->add(std::make_shared<ne::Sphere>(glm::vec3(0, -1000, 0), 1000.0f,
+                                          ground));
+  ne::Sampler sampler(11);
+  for (int i = 0; i < numLights; ++i) {
+    const glm::vec3 position(-20.0f + 40.0f * sampler.next1D(),
+                             0.2f + 2.0f * sampler.next1D(),
+                             -20.0f + 40.0f * sampler.next1D());
+    scene->add(std::make_shared<ne::Sphere>(position, 0.1f, light));
+  }
+  scene->setLightBvh(lightBvh);
+  scene->build();
+  return scene;
+}
+
+struct Result {
+  double usPerPoint;
+  double mean;
+  double relativeDeviation;
+};
+
+Result shade(const ne::Scene &scene, int numPoints) {
+  ne::Sampler points(3);
+  ne::Sampler sampler(5);
+  double sum = 0.0, sum2 = 0.0;
+  ne::utils::Timer timer(true);
+  for (int i = 0; i < numPoints; ++i) {
+    ne::Intersection hit;
+    hit.p = glm::vec3(-20.0f + 40.0f * points.next1D(), 0.0f,
+                      -20.0f + 40.0f * points.next1D());
+    hit.n = glm::vec3(0, 1, 0);
+    ne::Ray ray(hit.p, hit.n);
+    const double y = scene.sampleDirectLight(ray, hit, sampler).g;
+    sum += y;
+    sum2 += y * y;
+  }
+  timer.stop();
+  const double mean = sum / numPoints;
+  const double variance = std::max(0.0, sum2 / numPoints - mean * mean);
+  return {timer.count<std::chrono::microseconds>() / double(numPoints), mean,
+          std::sqrt(variance) / std::max(mean, 1e-12)};
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int numPoints = 20000;
+  std::printf("%8s %12s %12s %10s %10s %10s %10s %10s\n", "lights",
+              "all(us)", "bvh(us)", "speedup", "mean all", "mean bvh",
+              "dev all", "dev bvh");
+  for (int numLights : {1, 4, 16, 64, 256, 1024}) {
+    const Result all = shade(*lightField(numLights, false), numPoints);
+    const Result bvh = shade(*lightField(numLights, true), numPoints);
+    std::printf("%8d %12.2f %12.2f %9.1fx %10.4f %10.4f %10.2f %10.2f\n",
+                numLights, all.usPerPoint, bvh.usPerPoint,
+                all.usPerPoint / std::max(bvh.usPerPoint, 1e-9), all.mean,
+                bvh.mean, all.relativeDeviation, bvh.relativeDeviation);
+  }
+  return 0;
+}
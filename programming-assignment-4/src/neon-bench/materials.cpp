@@ -0,0 +1,125 @@
+// Material dispatch in the integrator inner loop: scatter, attenuation and
+// emitted through the virtual interface against ne::visit, on hits with
+// materials in random order (unpredictable branches) and sorted by material.
+// Usage: neon-bench-materials [hits]
+#include "neon/material.hpp"
+#include "neon/sampler.hpp"
+#include "neon/utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Hit {
+  ne::Ray ray;
+  ne::Intersection hit;
+};
+
+// the bounce of ne::Integrator::render without the tracing
+template <typename Dispatch>
+glm::vec3 shade(const std::vector<Hit> &hits, ne::Sampler &sampler,
+                Dispatch &&dispatch) {
+  glm::vec3 sum(0.0f);
+  for (const Hit &h : hits) {
+    ne::Ray scattered;
+    if (dispatch.scatter(*h.hit.material, h.ray, h.hit, scattered, sampler))
+      sum += dispatch.attenuation(*h.hit.material) * scattered.dir;
+    else
+      sum += dispatch.emitted(*h.hit.material);
+  }
+  return sum;
+}
+
+struct Virtual {
+  bool scatter(const ne::abstract::Material &m, const ne::Ray &r,
+               const ne::Intersection &hit, ne::Ray &out,
+               ne::Sampler &sampler) const {
+    return m.scatter(r, hit, out, sampler);
+  }
+  glm::vec3 attenuation(const ne::abstract::Material &m) const {
+    return m.attenuation();
+  }
+  glm::vec3 emitted(const ne::abstract::Material &m) const {
+    return m.emitted();
+  }
+};
+
+struct Static {
+  bool scatter(const ne::abstract::Material &m, const ne::Ray &r,
+               const ne::Intersection &hit, ne::Ray &out,
+               ne::Sampler &sampler) const {
+    return ne::scatter(m, r, hit, out, sampler);
+  }
+  glm::vec3 attenuation(const ne::abstract::Material &m) const {
+    return ne::attenuation(m);
+  }
+  glm::vec3 emitted(const ne::abstract::Material &m) const {
+    return ne::emitted(m);
+  }
+};
+
+// returns million hits per second, best of a few runs
+template <typename Dispatch>
+double run(const std::vector<Hit> &hits, Dispatch dispatch, float &check) {
+  long long best = -1;
+  for (int r = 0; r < 5; ++r) {
+    ne::Sampler sampler(42u);
+    ne::utils::Timer timer(true);
+    const glm::vec3 sum = shade(hits, sampler, dispatch);
+    timer.stop();
+    check = sum.x + sum.y + sum.z;
+    const long long us = timer.count<std::chrono::microseconds>();
+    best = best < 0 ? us : std::min(best, us);
+  }
+  return hits.size() / std::max(best * 1e-6, 1e-9) * 1e-6;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int count = argc > 1 ? std::max(1, std::stoi(argv[1])) : 4000000;
+
+  const std::vector<ne::MaterialPointer> materials = {
+      std::make_shared<ne::Lambertian>(glm::vec3(0.5f)),
+      std::make_shared<ne::Metal>(glm::vec3(0.8f), 0.3f),
+      std::make_shared<ne::Dielectric>(glm::vec3(1.0f), 1.5f),
+      std::make_shared<ne::DiffuseLight>(glm::vec3(4.0f)),
+  };
+
+  std::mt19937 gen(1234u);
+  std::normal_distribution<float> dir(0.0f, 1.0f);
+  std::discrete_distribution<int> pick({60, 20, 15, 5});
+  std::vector<Hit> hits(count);
+  for (Hit &h : hits) {
+    h.ray = ne::Ray(glm::vec3(0.0f), glm::vec3(dir(gen), dir(gen), dir(gen)));
+    h.hit.p = glm::vec3(dir(gen), dir(gen), dir(gen));
+    h.hit.n = glm::normalize(glm::vec3(dir(gen), dir(gen), dir(gen)));
+    h.hit.material = materials[pick(gen)].get();
+  }
+
+  std::printf("%10s %10s %12s %10s\n", "order", "dispatch", "Mhits/s",
+              "speedup");
+  for (const char *order : {"random", "sorted"}) {
+    if (std::string(order) == "sorted")
+      std::stable_sort(hits.begin(), hits.end(),
+                       [](const Hit &a, const Hit &b) {
+                         return a.hit.material->kind() < b.hit.material->kind();
+                       });
+    float checkVirtual, checkStatic;
+    const double rateVirtual = run(hits, Virtual(), checkVirtual);
+    const double rateStatic = run(hits, Static(), checkStatic);
+    // the same random stream is consumed either way
+    if (checkVirtual != checkStatic)
+      std::fprintf(stderr, "result mismatch: %f, %f\n", checkVirtual,
+                   checkStatic);
+    std::printf("%10s %10s %12.2f %10s\n", order, "virtual", rateVirtual, "");
+    std::printf("%10s %10s %12.2f %9.2fx\n", order, "static", rateStatic,
+                rateStatic / rateVirtual);
+  }
+  return 0;
+}
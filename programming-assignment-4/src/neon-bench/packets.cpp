@@ -0,0 +1,214 @@
+// Primary ray throughput of Scene::rayIntersect for single rays and for ray
+// packets, plus a packet of random directions to show the cost of the
+// incoherent fallback. Checks that both give the same hits, and that the
+// packet slab test agrees with AABB::hit for rays lying on box faces.
+#include "common.hpp"
+
+#include "neon/aabb.hpp"
+#include "neon/camera.hpp"
+#include "neon/material.hpp"
+#include "neon/raypacket.hpp"
+#include "neon/scene.hpp"
+#include "neon/sphere.hpp"
+#include "neon/trianglemesh.hpp"
+#include "neon/utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// field of spheres on a ground plane, seen from above the front edge
+std::shared_ptr<ne::Scene> sphereField(int count, std::mt19937 &gen) {
+  const ne::MaterialPointer material =
+      std::make_shared<ne::Lambertian>(glm::vec3(0.5f));
+  std::uniform_real_distribution<float> pos(-20.0f, 20.0f);
+  std::uniform_real_distribution<float> rad(0.1f, 0.5f);
+
+  auto scene = std::make_shared<ne::Scene>();
+  scene->add(std::make_shared<ne::Sphere>(glm::vec3(0, -1000, 0), 1000.0f,
+                                          material));
+  for (int i = 0; i < count; ++i) {
+    const float r = rad(gen);
+    scene->add(std::make_shared<ne::Sphere>(glm::vec3(pos(gen), r, pos(gen)),
+                                            r, material));
+  }
+  scene->build();
+  return scene;
+}
+
+// mesh fitted into the unit cube at the origin
+std::shared_ptr<ne::Scene> meshScene(const std::string &filename) {
+  std::shared_ptr<ne::MeshData> mesh = ne::loadObj(filename);
+  if (!mesh)
+    return nullptr;
+  const ne::AABB box = mesh->bounds();
+  const glm::vec3 extent = box.extent();
+  const float scale =
+      1.0f / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+  glm::mat4 m(1.0f);
+  m[0][0] = m[1][1] = m[2][2] = scale;
+  m[3] = glm::vec4(-scale * box.centroid(), 1.0f);
+  mesh->transform(m);
+
+  auto scene = std::make_shared<ne::Scene>();
+  scene->add(std::make_shared<ne::TriangleMesh>(
+      mesh, std::make_shared<ne::Lambertian>(glm::vec3(0.5f))));
+  scene->build();
+  return scene;
+}
+
+// camera rays of a size x size image, rows of RayPacket::width pixels
+// in 32 x 32 tiles as the sandbox renders them
+std::vector<ne::Ray> cameraRays(const ne::Camera &camera, int size) {
+  std::vector<ne::Ray> rays;
+  rays.reserve(size_t(size) * size);
+  for (int ty = 0; ty < size; ty += 32)
+    for (int tx = 0; tx < size; tx += 32)
+      for (int y = ty; y < std::min(ty + 32, size); ++y)
+        for (int x = tx; x < std::min(tx + 32, size); ++x)
+          rays.push_back(camera.sample((x + 0.5f) / size, (y + 0.5f) / size));
+  return rays;
+}
+
+// returns rays per second, t receives the hit distance of every ray
+double traceSingle(const ne::Scene &scene, const std::vector<ne::Ray> &rays,
+                   std::vector<float> &t) {
+  t.assign(rays.size(), -1.0f);
+  return bench::trace(scene, rays,
+                      [&t](size_t i, bool found, const ne::Ray &ray,
+                           const ne::Intersection &) {
+                        if (found)
+                          t[i] = ray.t;
+                      });
+}
+
+double tracePackets(const ne::Scene &scene, const std::vector<ne::Ray> &rays,
+                    std::vector<float> &t) {
+  constexpr int width = ne::RayPacket::width;
+  t.assign(rays.size(), -1.0f);
+  ne::utils::Timer timer(true);
+  ne::RayPacket packet;
+  ne::Intersection hits[width];
+  for (size_t i = 0; i < rays.size(); i += width) {
+    const int count = static_cast<int>(std::min<size_t>(width, rays.size() - i));
+    for (int lane = 0; lane < count; ++lane)
+      packet.rays[lane] = rays[i + lane];
+    packet.setup(count);
+    const uint32_t found = scene.rayIntersect(packet, hits);
+    for (int lane = 0; lane < count; ++lane)
+      if (found & (1u << lane))
+        t[i + lane] = packet.rays[lane].t;
+  }
+  timer.stop();
+  const double sec = timer.count<std::chrono::microseconds>() * 1e-6;
+  return rays.size() / std::max(sec, 1e-9);
+}
+
+void run(const char *name, const ne::Scene &scene,
+         const std::vector<ne::Ray> &rays) {
+  std::vector<float> singleT, packetT;
+  double single = 0.0, packet = 0.0;
+  // best of a few runs, the first one also warms the caches
+  for (int r = 0; r < 3; ++r) {
+    single = std::max(single, traceSingle(scene, rays, singleT));
+    packet = std::max(packet, tracePackets(scene, rays, packetT));
+  }
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < rays.size(); ++i)
+    mismatches += singleT[i] != packetT[i] ? 1 : 0;
+  if (mismatches > 0)
+    std::fprintf(stderr, "%s: %zu rays differ\n", name, mismatches);
+
+  std::printf("%-22s %10zu %14.3f %14.3f %9.2fx\n", name, rays.size(),
+              single * 1e-6, packet * 1e-6, packet / single);
+}
+
+// Rays starting on a face plane of [-1, 1]^3 and running parallel to it give
+// a NaN slab, which must not limit them. Returns the lanes of
+// RayPacket::hit that disagree with AABB::hit.
+int checkSlabPlanes() {
+  const ne::AABB box(glm::vec3(-1.0f), glm::vec3(1.0f));
+  const float offsets[] = {-2.0f, -1.0f, -0.5f, 0.0f, 0.5f, 1.0f, 2.0f};
+  std::vector<ne::Ray> rays;
+  for (int a = 0; a < 3; ++a) {
+    const int b = (a + 1) % 3, c = (a + 2) % 3;
+    for (float plane : {-1.0f, 1.0f})
+      for (float u : offsets)
+        for (float v : offsets)
+          for (const glm::vec2 d : {glm::vec2(0, 1), glm::vec2(1, 0),
+                                    glm::vec2(1, -1), glm::vec2(0, -1)}) {
+            glm::vec3 o(0.0f), dir(0.0f);
+            o[a] = plane;
+            o[b] = u;
+            o[c] = v - 3.0f; // in front of the box along c
+            dir[b] = d.x;
+            dir[c] = d.y;
+            rays.emplace_back(o, dir);
+          }
+  }
+
+  int mismatches = 0;
+  ne::RayPacket packet;
+  constexpr int width = ne::RayPacket::width;
+  for (size_t i = 0; i < rays.size(); i += width) {
+    const int count =
+        static_cast<int>(std::min<size_t>(width, rays.size() - i));
+    for (int lane = 0; lane < count; ++lane)
+      packet.rays[lane] = rays[i + lane];
+    packet.setup(count);
+    const uint32_t found = packet.hit(box, packet.valid);
+    for (int lane = 0; lane < count; ++lane) {
+      const ne::Ray &ray = packet.rays[lane];
+      float tNear;
+      const bool expected = box.hit(ray.o, 1.0f / ray.dir, ray.t, tNear);
+      mismatches += expected != bool(found & (1u << lane)) ? 1 : 0;
+    }
+  }
+  if (mismatches > 0)
+    std::fprintf(stderr, "slab planes: %d of %zu rays differ from AABB::hit\n",
+                 mismatches, rays.size());
+  return mismatches;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int imageSize = 512;
+  std::mt19937 gen(1234u);
+
+  std::printf("%-22s %10s %14s %14s %10s\n", "scene", "rays", "single(Mr/s)",
+              "packet(Mr/s)", "speedup");
+
+  const ne::Camera fieldCamera(glm::vec3(0, 3, 22), glm::vec3(0, 0, 0),
+                               glm::vec3(0, 1, 0), 60.0f, 1.0f);
+  for (int count : {100, 10000}) {
+    auto scene = sphereField(count, gen);
+    char name[64];
+    std::snprintf(name, sizeof(name), "spheres %d", count);
+    run(name, *scene, cameraRays(fieldCamera, imageSize));
+    std::snprintf(name, sizeof(name), "spheres %d random", count);
+    run(name, *scene,
+        bench::randomRays(glm::vec3(0, 1, 0),
+                          size_t(imageSize) * imageSize, gen));
+  }
+
+  // optional OBJ file, e.g. neon-bench-packets bunny.obj
+  if (argc > 1) {
+    auto scene = meshScene(argv[1]);
+    if (scene) {
+      const ne::Camera meshCamera(glm::vec3(0, 0.3f, 1.5f), glm::vec3(0),
+                                  glm::vec3(0, 1, 0), 50.0f, 1.0f);
+      run("mesh", *scene, cameraRays(meshCamera, imageSize));
+      run("mesh random", *scene,
+          bench::randomRays(glm::vec3(0), size_t(imageSize) * imageSize, gen));
+    }
+  }
+  return checkSlabPlanes() > 0 ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+// Packed sphere kernels: checks that every SIMD width reproduces the hits of
+// Sphere::rayIntersect bit for bit and reports their throughput.
+#include "common.hpp"
+
+#include "neon/scene.hpp"
+#include "neon/sphere.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+const char *simdName(ne::SpherePack::Simd simd) {
+  switch (simd) {
+  case ne::SpherePack::Simd::AVX512:
+    return "avx512";
+  case ne::SpherePack::Simd::AVX2:
+    return "avx2";
+  case ne::SpherePack::Simd::SSE:
+    return "sse";
+  default:
+    return "scalar";
+  }
+}
+
+struct Record {
+  bool found;
+  float t;
+  glm::vec3 n;
+};
+
+// rays per second, records receives the hit of every ray
+double trace(const ne::Scene &scene, const std::vector<ne::Ray> &rays,
+             std::vector<Record> &records) {
+  records.resize(rays.size());
+  return bench::trace(scene, rays,
+                      [&records](size_t i, bool found, const ne::Ray &ray,
+                                 const ne::Intersection &hit) {
+                        records[i] = {found, ray.t, hit.n};
+                      });
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int counts[] = {100, 1000, 100000};
+  const int numRays = 200000;
+  const ne::SpherePack::Simd levels[] = {
+      ne::SpherePack::Simd::Scalar, ne::SpherePack::Simd::SSE,
+      ne::SpherePack::Simd::AVX2, ne::SpherePack::Simd::AVX512};
+
+  std::printf("detected: %s\n", simdName(ne::SpherePack::detect()));
+  std::printf("%10s %8s %12s %10s\n", "spheres", "kernel", "Mrays/s",
+              "mismatch");
+
+  for (int count : counts) {
+    std::mt19937 gen(42u);
+    const float cubeSize = bench::cubeSize(count);
+    auto scene = bench::randomSpheres(count, cubeSize, gen);
+    const std::vector<ne::Ray> rays =
+        bench::randomRays(numRays, cubeSize, gen);
+
+    // reference: unbuilt scene runs the virtual Sphere::rayIntersect
+    std::vector<Record> reference;
+    if (count <= 1000) {
+      const double rate = trace(*scene, rays, reference);
+      std::printf("%10d %8s %12.3f %10s\n", count, "virtual", rate * 1e-6,
+                  "-");
+    }
+
+    for (auto simd : levels) {
+      if (static_cast<int>(simd) > static_cast<int>(ne::SpherePack::detect()))
+        continue;
+      scene->spheres().setSimd(simd);
+      scene->build();
+
+      std::vector<Record> records;
+      const double rate = trace(*scene, rays, records);
+
+      int mismatch = 0;
+      for (size_t i = 0; i < reference.size(); ++i) {
+        const Record &a = reference[i], &b = records[i];
+        if (a.found != b.found ||
+            (a.found && (a.t != b.t ||
+                         std::memcmp(&a.n, &b.n, sizeof(glm::vec3)) != 0)))
+          ++mismatch;
+      }
+
+      char mismatchText[32] = "-";
+      if (!reference.empty())
+        std::snprintf(mismatchText, sizeof(mismatchText), "%d", mismatch);
+      std::printf("%10d %8s %12.3f %10s\n", count, simdName(simd),
+                  rate * 1e-6, mismatchText);
+    }
+  }
+  return 0;
+}
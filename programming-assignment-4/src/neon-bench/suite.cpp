@@ -0,0 +1,399 @@
+// Microbenchmark suite of neon's kernels. Every benchmark is calibrated so a
+// repetition takes at least --min-time, warmed up and then repeated; the
+// report gives min, median, mean, standard deviation and max time per item.
+// --json writes the results as JSON, so build hosts can track regressions
+// across commits (--label tags the run, e.g. with the commit hash).
+// Usage: neon-bench [--json file] [--filter text] [--reps n] [--warmup n]
+//                   [--min-time ms] [--label text] [--list]
+#include "common.hpp"
+
+#include "neon/camera.hpp"
+#include "neon/image.hpp"
+#include "neon/intersection.hpp"
+#include "neon/material.hpp"
+#include "neon/sampler.hpp"
+#include "neon/scene.hpp"
+#include "neon/sphere.hpp"
+#include "neon/stats.hpp"
+#include "neon/utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// keeps the compiler from dropping a result nobody reads
+template <typename T> inline void keep(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile char sink;
+  sink = *reinterpret_cast<const volatile char *>(&value);
+#endif
+}
+
+struct Settings {
+  int reps = 15;
+  int warmup = 3;
+  double minTime = 0.02; // seconds per repetition
+  std::string filter;
+  std::string label;
+};
+
+struct Benchmark {
+  std::string name;
+  std::vector<std::pair<std::string, int64_t>> params;
+  // runs n items, e.g. traces n rays
+  std::function<void(uint64_t n)> run;
+
+  std::string fullName() const {
+    std::string s = name;
+    for (const auto &p : params)
+      s += " " + p.first + "=" + std::to_string(p.second);
+    return s;
+  }
+};
+
+// nanoseconds per item over the repetitions
+struct Statistics {
+  double min, median, mean, stddev, max;
+};
+
+struct Result {
+  const Benchmark *benchmark;
+  uint64_t items; // per repetition
+  int reps;
+  Statistics ns;
+};
+
+double seconds(const std::function<void(uint64_t)> &run, uint64_t n) {
+  ne::utils::Timer timer(true);
+  run(n);
+  timer.stop();
+  return timer.count<std::chrono::nanoseconds>() * 1e-9;
+}
+
+Statistics summarize(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  Statistics s;
+  s.min = v.front();
+  s.max = v.back();
+  const size_t mid = v.size() / 2;
+  s.median = v.size() % 2 ? v[mid] : 0.5 * (v[mid - 1] + v[mid]);
+  double sum = 0.0, sum2 = 0.0;
+  for (double x : v) {
+    sum += x;
+    sum2 += x * x;
+  }
+  s.mean = sum / v.size();
+  s.stddev = std::sqrt(std::max(0.0, sum2 / v.size() - s.mean * s.mean));
+  return s;
+}
+
+Result measure(const Benchmark &b, const Settings &settings) {
+  // grow the item count until one repetition takes minTime
+  uint64_t n = 1;
+  for (;;) {
+    const double t = seconds(b.run, n);
+    if (t >= settings.minTime || n >= (uint64_t(1) << 32))
+      break;
+    const double grow = t > 0.0 ? 1.2 * settings.minTime / t : 100.0;
+    n = static_cast<uint64_t>(n * std::min(std::max(grow, 2.0), 100.0));
+  }
+
+  for (int i = 0; i < settings.warmup; ++i)
+    seconds(b.run, n);
+  std::vector<double> ns;
+  for (int i = 0; i < settings.reps; ++i)
+    ns.push_back(seconds(b.run, n) * 1e9 / n);
+  return {&b, n, settings.reps, summarize(std::move(ns))};
+}
+
+// material of every benchmark scene
+ne::MaterialPointer gray() {
+  static const ne::MaterialPointer m =
+      std::make_shared<ne::Lambertian>(glm::vec3(0.5f));
+  return m;
+}
+
+constexpr size_t numInputs = 1024; // inputs are reused cyclically
+
+std::vector<Benchmark> benchmarks() {
+  std::vector<Benchmark> list;
+
+  // one sphere, about half of the rays hit it
+  {
+    auto sphere =
+        std::make_shared<ne::Sphere>(glm::vec3(0.0f), 1.0f, gray());
+    auto rays = std::make_shared<std::vector<ne::Ray>>();
+    ne::Sampler sampler(1);
+    for (size_t i = 0; i < numInputs; ++i) {
+      const glm::vec3 o = 4.0f * sampler.sphere();
+      const glm::vec3 target = 1.4f * sampler.sphere();
+      rays->emplace_back(o, target - o);
+    }
+    list.push_back({"sphere/rayIntersect", {}, [sphere, rays](uint64_t n) {
+                      for (uint64_t i = 0; i < n; ++i) {
+                        ne::Ray r = (*rays)[i % numInputs];
+                        ne::Intersection hit;
+                        keep(sphere->rayIntersect(r, hit));
+                      }
+                    }});
+  }
+
+  for (int objects : {16, 256, 4096, 65536}) {
+    std::mt19937 gen(7u);
+    const float cubeSize = bench::cubeSize(objects);
+    auto scene = bench::randomSpheres(objects, cubeSize, gen);
+    scene->build();
+    auto rays = std::make_shared<std::vector<ne::Ray>>(
+        bench::randomRays(int(numInputs), cubeSize, gen));
+    list.push_back({"scene/rayIntersect",
+                    {{"objects", objects}},
+                    [scene, rays](uint64_t n) {
+                      for (uint64_t i = 0; i < n; ++i) {
+                        ne::Ray r = (*rays)[i % numInputs];
+                        ne::Intersection hit;
+                        keep(scene->rayIntersect(r, hit));
+                      }
+                    }});
+  }
+
+  // scatter of every built-in material through the static dispatch the
+  // integrators use
+  {
+    struct Hit {
+      ne::Ray ray;
+      ne::Intersection hit;
+    };
+    auto hits = std::make_shared<std::vector<Hit>>(numInputs);
+    ne::Sampler sampler(3);
+    for (Hit &h : *hits) {
+      h.hit.n = sampler.sphere();
+      h.hit.p = h.hit.n;
+      // from the outside towards the surface
+      h.ray = ne::Ray(h.hit.p + h.hit.n + 0.5f * sampler.sphere(),
+                      -h.hit.n + 0.5f * sampler.sphere());
+    }
+    const std::pair<const char *, ne::MaterialPointer> materials[] = {
+        {"lambertian", std::make_shared<ne::Lambertian>(glm::vec3(0.5f))},
+        {"metal", std::make_shared<ne::Metal>(glm::vec3(0.8f), 0.3f)},
+        {"dielectric", std::make_shared<ne::Dielectric>(glm::vec3(1.0f), 1.5f)},
+        {"diffuse_light", std::make_shared<ne::DiffuseLight>(glm::vec3(4.0f))},
+    };
+    for (const auto &m : materials) {
+      ne::MaterialPointer material = m.second;
+      list.push_back({std::string("material/scatter/") + m.first,
+                      {},
+                      [hits, material](uint64_t n) {
+                        ne::Sampler sampler(4);
+                        for (uint64_t i = 0; i < n; ++i) {
+                          const Hit &h = (*hits)[i % numInputs];
+                          ne::Ray out;
+                          keep(ne::scatter(*material, h.ray, h.hit, out,
+                                           sampler));
+                          keep(out);
+                        }
+                      }});
+    }
+  }
+
+  // shading points on a floor under small lights, shadow rays included
+  for (int lights : {1, 64}) {
+    auto scene = std::make_shared<ne::Scene>();
+    scene->add(std::make_shared<ne::Sphere>(glm::vec3(0, -1000, 0), 1000.0f,
+                                            gray()));
+    const ne::MaterialPointer light = std::make_shared<ne::DiffuseLight>();
+    ne::Sampler sampler(5);
+    for (int i = 0; i < lights; ++i) {
+      const glm::vec3 p(-10.0f + 20.0f * sampler.next1D(),
+                        0.5f + 2.0f * sampler.next1D(),
+                        -10.0f + 20.0f * sampler.next1D());
+      scene->add(std::make_shared<ne::Sphere>(p, 0.1f, light));
+    }
+    scene->build();
+    auto points = std::make_shared<std::vector<ne::Intersection>>(numInputs);
+    for (ne::Intersection &hit : *points) {
+      hit.p = glm::vec3(-10.0f + 20.0f * sampler.next1D(), 0.0f,
+                        -10.0f + 20.0f * sampler.next1D());
+      hit.n = glm::vec3(0, 1, 0);
+      hit.material = gray().get();
+    }
+    list.push_back({"scene/sampleDirectLight",
+                    {{"lights", lights}},
+                    [scene, points](uint64_t n) {
+                      ne::Sampler sampler(6);
+                      for (uint64_t i = 0; i < n; ++i) {
+                        ne::Intersection hit = (*points)[i % numInputs];
+                        ne::Ray ray(hit.p, hit.n);
+                        keep(scene->sampleDirectLight(ray, hit, sampler));
+                      }
+                    }});
+  }
+
+  // the sandbox's camera
+  {
+    auto camera = std::make_shared<ne::Camera>(
+        glm::vec3(0, 0, 3), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0), 60.0f,
+        1.0f, 0.1f, 4.0f);
+    list.push_back({"camera/sample", {}, [camera](uint64_t n) {
+                      ne::Sampler sampler(8);
+                      for (uint64_t i = 0; i < n; ++i)
+                        keep(camera->sample(sampler.next1D(),
+                                            sampler.next1D()));
+                    }});
+  }
+
+  // PNG encode including the file write, of a gradient with noise
+  for (unsigned size : {128u, 512u}) {
+    auto image = std::make_shared<ne::Image>(size, size);
+    ne::Sampler sampler(9);
+    for (unsigned y = 0; y < size; ++y)
+      for (unsigned x = 0; x < size; ++x)
+        (*image)(glm::uvec2(x, y)) = glm::u8vec4(
+            x * 255 / size, y * 255 / size,
+            static_cast<unsigned char>(255.0f * sampler.next1D()), 255);
+    list.push_back({"image/save",
+                    {{"width", size}, {"height", size}},
+                    [image](uint64_t n) {
+                      for (uint64_t i = 0; i < n; ++i)
+                        image->save("neon-bench.png");
+                    }});
+  }
+
+  {
+    auto image = std::make_shared<ne::Image>(1920u, 1080u);
+    list.push_back({"image/toTiles",
+                    {{"width", 1920}, {"height", 1080}, {"tile", 32}},
+                    [image](uint64_t n) {
+                      for (uint64_t i = 0; i < n; ++i)
+                        keep(image->toTiles(glm::uvec2(32)).size());
+                    }});
+  }
+  return list;
+}
+
+std::string escape(const std::string &s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    if (static_cast<unsigned char>(c) >= 0x20)
+      out += c;
+  }
+  return out;
+}
+
+bool writeJson(const std::string &path, const std::vector<Result> &results,
+               const Settings &settings) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cout << "JSON write to " << path << " failed" << std::endl;
+    return false;
+  }
+
+  char date[32];
+  const std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+#if defined(__clang__)
+  const std::string compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+  const std::string compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+  const std::string compiler = "MSVC " + std::to_string(_MSC_VER);
+#else
+  const std::string compiler = "unknown";
+#endif
+
+  out << "{\n  \"context\": {\"date\": \"" << date << "\", \"label\": \""
+      << escape(settings.label) << "\", \"compiler\": \"" << escape(compiler)
+      << "\", \"stats\": " << NE_STATS << ", \"repetitions\": "
+      << settings.reps << ", \"warmup\": " << settings.warmup
+      << ", \"min_time_ms\": " << settings.minTime * 1e3 << "},\n";
+  out << "  \"benchmarks\": [";
+  char line[512];
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &r = results[i];
+    out << (i ? ",\n" : "\n") << "    {\"name\": \""
+        << escape(r.benchmark->name) << "\", \"params\": {";
+    for (size_t p = 0; p < r.benchmark->params.size(); ++p)
+      out << (p ? ", " : "") << '"' << escape(r.benchmark->params[p].first)
+          << "\": " << r.benchmark->params[p].second;
+    std::snprintf(line, sizeof(line),
+                  "}, \"items_per_repetition\": %llu, \"repetitions\": %d, "
+                  "\"ns_per_item\": {\"min\": %.4g, \"median\": %.4g, "
+                  "\"mean\": %.4g, \"stddev\": %.4g, \"max\": %.4g}, "
+                  "\"items_per_second\": %.6g}",
+                  (unsigned long long)r.items, r.reps, r.ns.min, r.ns.median,
+                  r.ns.mean, r.ns.stddev, r.ns.max, 1e9 / r.ns.median);
+    out << line;
+  }
+  out << "\n  ]\n}\n";
+
+  if (!out) {
+    std::cout << "JSON write to " << path << " failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Settings settings;
+  std::string jsonPath;
+  bool list = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc)
+      jsonPath = argv[++i];
+    else if (arg == "--filter" && i + 1 < argc)
+      settings.filter = argv[++i];
+    else if (arg == "--reps" && i + 1 < argc)
+      settings.reps = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "--warmup" && i + 1 < argc)
+      settings.warmup = std::max(0, std::stoi(argv[++i]));
+    else if (arg == "--min-time" && i + 1 < argc)
+      settings.minTime = std::max(0.0, std::stod(argv[++i]) * 1e-3);
+    else if (arg == "--label" && i + 1 < argc)
+      settings.label = argv[++i];
+    else if (arg == "--list")
+      list = true;
+  }
+
+  const std::vector<Benchmark> all = benchmarks();
+  std::vector<Result> results;
+  if (!list)
+    std::printf("%-44s %11s %11s %11s %8s %11s\n", "benchmark", "min(ns)",
+                "median(ns)", "mean(ns)", "stddev", "Mitems/s");
+  for (const Benchmark &b : all) {
+    const std::string name = b.fullName();
+    if (name.find(settings.filter) == std::string::npos)
+      continue;
+    if (list) {
+      std::printf("%s\n", name.c_str());
+      continue;
+    }
+    results.push_back(measure(b, settings));
+    const Statistics &s = results.back().ns;
+    std::printf("%-44s %11.5g %11.5g %11.5g %7.1f%% %11.4g\n", name.c_str(),
+                s.min, s.median, s.mean, 100.0 * s.stddev / s.mean,
+                1e3 / s.median);
+    std::fflush(stdout);
+  }
+  std::remove("neon-bench.png");
+
+  if (!jsonPath.empty() && !writeJson(jsonPath, results, settings))
+    return 1;
+  return 0;
+}
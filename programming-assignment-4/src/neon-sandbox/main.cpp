@@ -1,18 +1,35 @@
 #include "test.hpp"
 
+#include "neon/adaptive.hpp"
+#include "neon/aov.hpp"
 #include "neon/camera.hpp"
+#include "neon/checkpoint.hpp"
+#include "neon/denoiser.hpp"
+#include "neon/film.hpp"
 #include "neon/image.hpp"
 #include "neon/integrator.hpp"
 #include "neon/ray.hpp"
+#include "neon/raypacket.hpp"
+#include "neon/sampler.hpp"
 #include "neon/scene.hpp"
+#include "neon/scheduler.hpp"
 #include "neon/sphere.hpp"
+#include "neon/stats.hpp"
+#include "neon/trace.hpp"
 #include "neon/utils.hpp"
+#include "neon/wavefront.hpp"
 
 #include <glm/gtx/string_cast.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <taskflow/taskflow.hpp>
-#include <random>
+#include <string>
+#include <thread>
 
 int main(int argc, char* argv[]) {
     int nx = 128; //128
@@ -20,16 +37,195 @@ int main(int argc, char* argv[]) {
    
     int spp = 128;
 
+    // number of render threads, e.g. --threads 16 to measure scaling
+    unsigned numThreads = std::thread::hardware_concurrency();
+    // same seed gives the same image for any number of threads
+    uint64_t seed = 0;
+    // "path" traces depth first, "wavefront" runs breadth first per tile
+    std::string integrator = "path";
+    // path termination, see ne::core::IntegratorSettings
+    ne::core::IntegratorSettings settings;
+    int sceneId = 1;
+    // lights of scene 5
+    int numLights = 256;
+    // OBJ file for scene 3
+    std::string objFile;
+    // print how many rays the paths traced
+    bool histogram = false;
+    // spend spp per pixel on average, more on noisy pixels
+    bool adaptive = false;
+    ne::AdaptiveSettings adaptiveSettings;
+    adaptiveSettings.maxSpp = 8 * spp;
+    // samples per progressive pass, a preview is written after each pass
+    int passSpp = 16;
+    ne::Film::Tonemap tonemap = ne::Film::Tonemap::Clamp;
+    // save finished tiles every few seconds, --resume continues from there
+    std::string checkpointPath;
+    bool resume = false;
+    int checkpointInterval = 10;
+    // order in which tiles are handed out, see ne::TileScheduler
+    ne::TileOrder tileOrder = ne::TileOrder::Hilbert;
+    // trace camera rays of 8 neighbouring pixels together, same image
+    bool packets = true;
+    // single rays traverse 8 wide BVHs with quantized bounds
+    bool wideBvh = false;
+    // "sah" for the best trees, "morton" (LBVH) for fast builds
+    ne::BvhBuilder bvhBuilder = ne::BvhBuilder::BinnedSah;
+    // pick lights by importance instead of sampling every light
+    bool lightBvh = true;
+    // filter the result guided by first hit albedo and normal
+    bool denoise = false;
+    // write depth, normal, albedo, material, sample count and time per pixel
+    bool aov = false;
+    // Chrome trace JSON of scene build, passes, tiles and PNG encodes
+    std::string tracePath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--spp" && i + 1 < argc) {
+            spp = std::max(1, std::stoi(argv[++i]));
+            adaptiveSettings.maxSpp = 8 * spp;
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            numThreads = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        }
+        else if (arg == "--integrator" && i + 1 < argc) {
+            integrator = argv[++i];
+        }
+        else if (arg == "--max-depth" && i + 1 < argc) {
+            settings.maxDepth = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--min-depth" && i + 1 < argc) {
+            settings.minDepth = std::max(0, std::stoi(argv[++i]));
+        }
+        else if (arg == "--no-rr") {
+            settings.russianRoulette = false;
+        }
+        else if (arg == "--scene" && i + 1 < argc) {
+            sceneId = std::stoi(argv[++i]);
+        }
+        else if (arg == "--obj" && i + 1 < argc) {
+            objFile = argv[++i];
+            sceneId = std::max(sceneId, 3);
+        }
+        else if (arg == "--lights" && i + 1 < argc) {
+            numLights = std::max(1, std::stoi(argv[++i]));
+            sceneId = 5;
+        }
+        else if (arg == "--no-light-bvh") {
+            lightBvh = false;
+        }
+        else if (arg == "--denoise") {
+            denoise = true;
+        }
+        else if (arg == "--aov") {
+            aov = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        }
+        else if (arg == "--histogram") {
+            histogram = true;
+        }
+        else if (arg == "--adaptive") {
+            adaptive = true;
+        }
+        else if (arg == "--threshold" && i + 1 < argc) {
+            adaptiveSettings.threshold = std::stof(argv[++i]);
+        }
+        else if (arg == "--pass-spp" && i + 1 < argc) {
+            passSpp = std::stoi(argv[++i]);
+        }
+        else if (arg == "--tonemap" && i + 1 < argc) {
+            tonemap = std::string(argv[++i]) == "reinhard" ? ne::Film::Tonemap::Reinhard
+                                                           : ne::Film::Tonemap::Clamp;
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        }
+        else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+            checkpointInterval = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--resume") {
+            resume = true;
+        }
+        else if (arg == "--bvh8") {
+            wideBvh = true;
+        }
+        else if (arg == "--bvh-builder" && i + 1 < argc) {
+            bvhBuilder = std::string(argv[++i]) == "morton" ? ne::BvhBuilder::Morton
+                                                            : ne::BvhBuilder::BinnedSah;
+        }
+        else if (arg == "--no-packets") {
+            packets = false;
+        }
+        else if (arg == "--tile-order" && i + 1 < argc) {
+            const std::string order = argv[++i];
+            tileOrder = order == "scanline" ? ne::TileOrder::Scanline
+                : order == "morton"         ? ne::TileOrder::Morton
+                                            : ne::TileOrder::Hilbert;
+        }
+    }
+
+    // the wavefront integrator has no adaptive mode, and adaptive tiles are
+    // kept whole by the scheduler, so the combination would only cost balance
+    if (adaptive && integrator == "wavefront") {
+        std::printf("--adaptive is not supported by the wavefront integrator, ignored\n");
+        adaptive = false;
+    }
+
+    if (!tracePath.empty()) {
+        ne::trace::enable();
+        ne::trace::setThreadName("main");
+    }
+
     // create output image
     ne::Image canvas(nx, ny);
     glm::uvec2 tilesize(32, 32);
 
+    // HDR accumulation buffer. Every pass adds its samples here and the
+    // canvas is developed from it, so the render can be stopped after any
+    // pass and still leave a usable 2.png behind.
+    ne::Film film(canvas.size());
+    if (adaptive)
+        passSpp = spp; // adaptive sampling distributes the whole budget at once
+    passSpp = std::max(1, std::min(passSpp, spp));
+    const int numPasses = (spp + passSpp - 1) / passSpp;
+
     // Split images into set of tiles.
     // Each thread render its corresponding tile.
     std::vector<ne::TileIterator> tiles = canvas.toTiles(tilesize);
 
+    // per pixel channels next to the color, also the denoiser's guides.
+    // Empty unless --aov or --denoise asks for them.
+    const bool recordAovs = aov || denoise;
+    ne::AovBuffer aovs = recordAovs ? ne::AovBuffer(tiles, canvas.size()) : ne::AovBuffer();
+
+    // one long running task per thread pulls tiles from the scheduler.
+    // Adaptive sampling spends its budget per tile, so its tiles stay whole.
+    ne::TileScheduler scheduler(tiles, numThreads, tileOrder,
+        adaptive ? std::max(tilesize.x, tilesize.y) : 8);
+
     // create scene
-    std::shared_ptr<ne::Scene> scene = testScene1();
+    std::shared_ptr<ne::Scene> scene;
+    {
+        ne::trace::Scope span("scene load", "scene");
+        scene = sceneId == 5 ? testScene5(numLights)
+            : sceneId == 4   ? testScene4(objFile)
+            : sceneId == 3   ? testScene3(objFile)
+            : sceneId == 2   ? testScene2()
+                             : testScene1();
+    }
+    scene->setWideBvh(wideBvh);
+    scene->setBvhBuilder(bvhBuilder, numThreads);
+    scene->setLightBvh(lightBvh);
+    ne::utils::Timer buildTimer(true);
+    scene->build();
+    buildTimer.stop();
+    std::printf("BVH build %.2f ms, SAH cost %.2f\n",
+        buildTimer.count<std::chrono::microseconds>() * 1e-3, scene->sahCost());
 
 
     // spwan camera
@@ -42,58 +238,365 @@ int main(int argc, char* argv[]) {
         float(canvas.width()) / float(canvas.height()), aperture,
         distToFocus);
 
+    // one random stream per pixel, independent of scheduling. Streams live
+    // across passes so a progressive render equals a single pass one.
+    std::vector<ne::Sampler> samplers(canvas.numPixels());
+    for (unsigned int j = 0; j < canvas.height(); ++j)
+        for (unsigned int i = 0; i < canvas.width(); ++i)
+            samplers[i + j * canvas.width()].seed(seed, i + j * canvas.width());
+
+    if (resume && checkpointPath.empty())
+        checkpointPath = "2.ckpt";
+    std::unique_ptr<ne::Checkpoint> checkpoint;
+    if (!checkpointPath.empty()) {
+        // everything besides size, tiling and seed that changes the image
+        const std::string description = "scene " + std::to_string(sceneId) +
+            " obj " + objFile + " lights " + std::to_string(numLights) +
+            (lightBvh ? " light-bvh" : "") + " spp " + std::to_string(spp) +
+            " pass-spp " + std::to_string(passSpp) + " integrator " + integrator +
+            " depth " + std::to_string(settings.minDepth) + "-" +
+            std::to_string(settings.maxDepth) + (settings.russianRoulette ? " rr" : "") +
+            (adaptive ? " adaptive " + std::to_string(adaptiveSettings.threshold) + " " +
+                            std::to_string(adaptiveSettings.maxSpp)
+                      : "");
+        checkpoint = std::make_unique<ne::Checkpoint>(checkpointPath, canvas.size(), tiles, seed,
+            ne::Checkpoint::hash(description));
+        if (resume && checkpoint->load()) {
+            uint64_t done = 0;
+            for (size_t t = 0; t < tiles.size(); ++t) {
+                checkpoint->restore(t, film, samplers);
+                done += checkpoint->samples(t);
+            }
+            std::printf("resuming %s, %.1f%% of the tiles' samples done\n",
+                checkpointPath.c_str(), 100.0 * done / (double(spp) * tiles.size()));
+        }
+        checkpoint->start(std::chrono::seconds(checkpointInterval));
+    }
+
     // summon progress bar. this is just eye candy.
     // you can use timer class instead
-    ne::utils::Progressbar progressbar(canvas.numPixels());
+    ne::utils::Progressbar progressbar(canvas.numPixels() * numPasses);
 
-    // prep to build task graph
-    tf::Taskflow tf;
-    tf::Task taskRenderStart =
-        tf.emplace([&progressbar]() { progressbar.start(); });
-    tf::Task taskRenderEnd = tf.emplace([&progressbar]() { progressbar.end(); });
+    // path statistics of all tiles, merged once per tile
+    ne::core::PathStatistics pathStatistics;
+    std::mutex statisticsMutex;
+    auto mergeStatistics = [&](const ne::core::PathStatistics& s) {
+        std::lock_guard<std::mutex> lock(statisticsMutex);
+        pathStatistics.merge(s);
+    };
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+    // time spent on pixels, in nanoseconds
+    using Clock = std::chrono::steady_clock;
+    auto elapsed = [](Clock::time_point start) {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    };
+    auto addAovs = [&](const glm::uvec2 index, const ne::core::FirstHit& sum, uint32_t count, uint64_t time) {
+        aovs.add(index, sum, count, sum.material ? scene->materialIndex(sum.material) : 0, time);
+    };
+    const ne::core::FirstHit noHits{ glm::vec3(0.0f), glm::vec3(0.0f) };
 
-    // build rendering task graph
-    for (auto& tile : tiles) {
-        tf::Task taskTileRender = tf.emplace([&]() {
-            // Iterate pixels in tile
+    // render samples [firstSample, firstSample + numSamples) of a tile
+    auto renderSamples = [&](const ne::TileIterator& tile, int firstSample, int numSamples) {
+        if (integrator == "wavefront") {
+            // breadth first has no per pixel cost, the tile's is shared evenly
+            const Clock::time_point start = Clock::now();
+            ne::core::WavefrontIntegrator wavefront(settings);
+            std::vector<glm::vec3> radiance;
+            std::vector<ne::core::FirstHit> firstHits;
+            wavefront.render(*scene, camera, tile, canvas.size(), firstSample, numSamples, seed, radiance,
+                recordAovs ? &firstHits : nullptr);
+            mergeStatistics(wavefront.statistics());
+            const uint64_t time = elapsed(start) / std::max(tile.numPixels(), 1u);
+
+            size_t i = 0;
             for (auto& index : tile) {
-                glm::vec3 color{ 0.0f };
-                for (int s = 0; s < spp; ++s) {
-                    float u = (float(index.x) + dis(gen)) / float(canvas.width());
-                    float v = (float(index.y) + dis(gen)) / float(canvas.height());
+                if (recordAovs)
+                    addAovs(index, firstHits[i], numSamples, time);
+                film.add(index, radiance[i++] * float(numSamples), numSamples);
+            }
+            progressbar.increase(static_cast<unsigned int>(radiance.size()));
+            progressbar.display();
+            return;
+        }
+
+        ne::core::Integrator Li(settings);
 
-                    // construct ray
-                    ne::Ray r = camera.sample(u, v);
+        if (adaptive) {
+            std::vector<glm::uvec2> pixels;
+            for (auto& index : tile)
+                pixels.push_back(index);
 
-                    // compute color of ray sample and then add to pixel
-                    ne::core::Integrator Li;
-                    color += Li.integrate(r, scene);
+            std::vector<ne::PixelEstimator> estimators;
+            std::vector<ne::core::FirstHit> firstHits(pixels.size(), noHits);
+            std::vector<uint64_t> times(pixels.size(), 0);
+            ne::renderAdaptive(static_cast<uint32_t>(pixels.size()), spp, adaptiveSettings,
+                [&](uint32_t p) {
+                    const Clock::time_point start = Clock::now();
+                    ne::Sampler& sampler = samplers[pixels[p].x + pixels[p].y * canvas.width()];
+                    float u = (float(pixels[p].x) + sampler.next1D()) / float(canvas.width());
+                    float v = (float(pixels[p].y) + sampler.next1D()) / float(canvas.height());
+                    ne::core::FirstHit first;
+                    const glm::vec3 radiance = Li.integrate(camera.sample(u, v), scene, sampler,
+                        recordAovs ? &first : nullptr);
+                    if (recordAovs) {
+                        firstHits[p] += first;
+                        times[p] += elapsed(start);
+                    }
+                    return radiance;
+                }, estimators);
 
+            for (size_t p = 0; p < pixels.size(); ++p) {
+                if (recordAovs)
+                    addAovs(pixels[p], firstHits[p], estimators[p].count, times[p]);
+                film.add(pixels[p], estimators[p].sum, estimators[p].count);
+            }
+            progressbar.increase(static_cast<unsigned int>(pixels.size()));
+            progressbar.display();
+            mergeStatistics(Li.statistics());
+            return;
+        }
+
+        if (packets) {
+            std::vector<glm::uvec2> pixels;
+            for (auto& index : tile)
+                pixels.push_back(index);
+            std::vector<glm::vec3> colors(pixels.size(), glm::vec3(0.0f));
+            std::vector<ne::core::FirstHit> firstHits(pixels.size(), noHits);
+            std::vector<uint64_t> times(pixels.size(), 0);
+
+            // sample by sample over rows of pixels. Every pixel owns its
+            // sampler, so the order across pixels does not change the image.
+            // The lanes of a packet share its time evenly.
+            constexpr int width = ne::RayPacket::width;
+            ne::RayPacket packet;
+            ne::Sampler* laneSamplers[width];
+            glm::vec3 radiance[width];
+            ne::core::FirstHit laneHits[width];
+            for (int s = 0; s < numSamples; ++s) {
+                for (size_t p = 0; p < pixels.size(); p += width) {
+                    const int count = static_cast<int>(std::min<size_t>(width, pixels.size() - p));
+                    const Clock::time_point start = Clock::now();
+                    for (int lane = 0; lane < count; ++lane) {
+                        const glm::uvec2 index = pixels[p + lane];
+                        ne::Sampler& sampler = samplers[index.x + index.y * canvas.width()];
+                        float u = (float(index.x) + sampler.next1D()) / float(canvas.width());
+                        float v = (float(index.y) + sampler.next1D()) / float(canvas.height());
+                        packet.rays[lane] = camera.sample(u, v);
+                        laneSamplers[lane] = &sampler;
+                    }
+                    packet.setup(count);
+                    Li.integrate(packet, scene, laneSamplers, radiance, recordAovs ? laneHits : nullptr);
+                    for (int lane = 0; lane < count; ++lane)
+                        colors[p + lane] += radiance[lane];
+                    if (recordAovs) {
+                        const uint64_t time = elapsed(start) / count;
+                        for (int lane = 0; lane < count; ++lane) {
+                            firstHits[p + lane] += laneHits[lane];
+                            times[p + lane] += time;
+                        }
+                    }
                 }
+            }
+
+            for (size_t p = 0; p < pixels.size(); ++p) {
+                if (recordAovs)
+                    addAovs(pixels[p], firstHits[p], numSamples, times[p]);
+                film.add(pixels[p], colors[p], numSamples);
+            }
+            progressbar.increase(static_cast<unsigned int>(pixels.size()));
+            progressbar.display();
+            mergeStatistics(Li.statistics());
+            return;
+        }
+
+        // Iterate pixels in tile
+        for (auto& index : tile) {
+            const Clock::time_point start = Clock::now();
+            ne::Sampler& sampler = samplers[index.x + index.y * canvas.width()];
 
-                color /= float(spp); // Average the color
-                color = glm::clamp(color, 0.0f, 1.0f);
+            glm::vec3 color{ 0.0f };
+            ne::core::FirstHit firstHits = noHits;
+            for (int s = 0; s < numSamples; ++s) {
+                float u = (float(index.x) + sampler.next1D()) / float(canvas.width());
+                float v = (float(index.y) + sampler.next1D()) / float(canvas.height());
 
-                // record to canvas
-                canvas(index) = glm::u8vec4(color * 255.99f, 255.0f);
+                // construct ray
+                ne::Ray r = camera.sample(u, v);
 
-                // update progressbar and draw it every 10 progress
-                if (++progressbar % 20 == 0)
-                    progressbar.display();
+                // compute color of ray sample and then add to pixel
+                ne::core::FirstHit first;
+                color += Li.integrate(r, scene, sampler, recordAovs ? &first : nullptr);
+                firstHits += first;
             }
+
+            // record to film
+            if (recordAovs)
+                addAovs(index, firstHits, numSamples, elapsed(start));
+            film.add(index, color, numSamples);
+
+            // update progressbar and draw it every 10 progress
+            if (++progressbar % 20 == 0)
+                progressbar.display();
+        }
+        mergeStatistics(Li.statistics());
+    };
+
+    // renders a piece of a tile, skipping the samples a resumed checkpoint
+    // already holds. The tile is checkpointed once all its pieces are done.
+    auto renderTile = [&](const ne::ScheduledTile& piece, int firstSample, int numSamples) {
+        const int end = firstSample + numSamples;
+        const int done = checkpoint ? static_cast<int>(checkpoint->samples(piece.tile)) : 0;
+        if (done >= end) {
+            progressbar.increase(piece.pixels.numPixels());
+            scheduler.complete(piece);
+            return;
+        }
+
+        firstSample = std::max(firstSample, done);
+        renderSamples(piece.pixels, firstSample, end - firstSample);
+        if (scheduler.complete(piece) && checkpoint)
+            checkpoint->store(piece.tile, end, film, samplers);
+    };
+
+    // prep to build task graph
+    tf::Taskflow tf(numThreads);
+    tf::Task taskRenderStart =
+        tf.emplace([&progressbar]() { progressbar.start(); });
+
+    // build rendering task graph, one stage per pass. The end of a pass
+    // develops the film into a preview before the next pass starts.
+    tf::Task taskPassStart = taskRenderStart;
+    std::vector<uint64_t> passBegin(numPasses, 0);
+    for (int pass = 0; pass < numPasses; ++pass) {
+        const int firstSample = pass * passSpp;
+        const int numSamples = std::min(passSpp, spp - firstSample);
+
+        tf::Task taskPassBegin = tf.emplace([&, pass]() {
+            passBegin[pass] = ne::trace::now();
+            scheduler.reset();
+        });
+        tf::Task taskPassEnd = tf.emplace([&, pass]() {
+            scheduler.finish();
+            if (ne::trace::enabled()) {
+                // begins on another thread, gets a row of its own
+                ne::trace::Event event{ "pass", "render", passBegin[pass], ne::trace::now() };
+                event.asyncId = pass + 1;
+                event.argNames[0] = "pass";
+                event.args[0] = pass;
+                ne::trace::record(event);
+            }
+            // the next pass waits for the preview, a slow encode shows up
+            // as a gap in the tile tracks
+            {
+                ne::trace::Scope span("develop", "io");
+                film.tonemap(canvas, tonemap);
+            }
+            if (pass + 1 < numPasses)
+                canvas.save("2.png");
+        });
+        taskPassStart.precede(taskPassBegin);
+
+        for (unsigned int w = 0; w < scheduler.numWorkers(); ++w) {
+            tf::Task taskWorker = tf.emplace([&, w, firstSample, numSamples]() {
+                scheduler.work(w, [&](const ne::ScheduledTile& piece) {
+                    renderTile(piece, firstSample, numSamples);
+                });
             });
 
-        taskRenderStart.precede(taskTileRender);
-        taskTileRender.precede(taskRenderEnd);
+            taskPassBegin.precede(taskWorker);
+            taskWorker.precede(taskPassEnd);
+        }
+        taskPassStart = taskPassEnd;
     }
+    tf::Task taskRenderEnd = tf.emplace([&progressbar]() { progressbar.end(); });
+    taskPassStart.precede(taskRenderEnd);
 
     // start rendering
-    tf.wait_for_all();
+    ne::utils::Timer renderTimer(true);
+    {
+        ne::trace::Scope span("render", "render");
+        span.arg("passes", numPasses).arg("threads", numThreads);
+        tf.wait_for_all();
+    }
+    renderTimer.stop();
+    if (checkpoint)
+        checkpoint->stop();
+
+    // time each thread spent waiting for the others at the end of a pass
+    scheduler.report(std::cout);
+    scheduler.reportTiles(std::cout);
+#if NE_STATS
+    // counted per thread while rendering, summed now that all threads wait
+    ne::stats::report(std::cout, ne::stats::collect(),
+        renderTimer.count<std::chrono::microseconds>() * 1e-6);
+#endif
+
+    if (histogram) {
+        uint64_t paths = 0, rays = 0;
+        for (size_t n = 0; n < pathStatistics.lengths.size(); ++n) {
+            paths += pathStatistics.lengths[n];
+            rays += n * pathStatistics.lengths[n];
+        }
+        std::printf("%8s %12s %8s\n", "rays", "paths", "share");
+        for (size_t n = 0; n < pathStatistics.lengths.size(); ++n) {
+            std::printf("%8zu %12llu %7.2f%%\n", n,
+                (unsigned long long)pathStatistics.lengths[n],
+                100.0 * pathStatistics.lengths[n] / std::max<uint64_t>(paths, 1));
+        }
+        std::printf("paths %llu, rays %llu, %.3f rays/path, %llu killed by roulette\n",
+            (unsigned long long)paths, (unsigned long long)rays,
+            double(rays) / std::max<uint64_t>(paths, 1),
+            (unsigned long long)pathStatistics.rouletteTerminated);
+    }
+
+    if (denoise) {
+        // keep the unfiltered render next to the result
+        canvas.save("2_noisy.png");
+        ne::Film albedoFilm, normalFilm, filtered;
+        aovs.film(ne::AovChannel::Albedo, albedoFilm);
+        aovs.film(ne::AovChannel::Normal, normalFilm);
+        ne::utils::Timer denoiseTimer(true);
+        ne::Denoiser().denoise(film, albedoFilm, normalFilm, filtered, numThreads);
+        denoiseTimer.stop();
+        std::printf("denoise %.2f ms\n", denoiseTimer.count<std::chrono::microseconds>() * 1e-3);
+        filtered.tonemap(canvas, tonemap);
+    }
 
     canvas.save("2.png");
+
+    if (aov) {
+        // 2_time.png is the cost heatmap, the report names the hot tiles
+        aovs.save("2");
+        aovs.report(std::cout);
+    }
+
+    if (adaptive) {
+        // achieved samples per pixel, white is the busiest pixel
+        uint32_t minCount = std::numeric_limits<uint32_t>::max(), maxCount = 1;
+        for (unsigned int j = 0; j < canvas.height(); ++j) {
+            for (unsigned int i = 0; i < canvas.width(); ++i) {
+                minCount = std::min(minCount, film.count(glm::uvec2(i, j)));
+                maxCount = std::max(maxCount, film.count(glm::uvec2(i, j)));
+            }
+        }
+        uint64_t total = 0;
+        ne::Image heatmap(canvas.size());
+        for (unsigned int j = 0; j < canvas.height(); ++j) {
+            for (unsigned int i = 0; i < canvas.width(); ++i) {
+                const uint32_t count = film.count(glm::uvec2(i, j));
+                total += count;
+                const unsigned char level = static_cast<unsigned char>(255.0f * count / maxCount);
+                heatmap(glm::uvec2(i, j)) = glm::u8vec4(level, level, level, 255);
+            }
+        }
+        heatmap.save("2_spp.png");
+        std::printf("samples per pixel: min %u, mean %.1f, max %u\n", minCount,
+            double(total) / canvas.numPixels(), maxCount);
+    }
+
+    // every thread is idle now, their buffers can be read
+    if (!tracePath.empty() && ne::trace::write(tracePath))
+        std::printf("trace: %zu events written to %s\n", ne::trace::size(), tracePath.c_str());
     return 0;
 }
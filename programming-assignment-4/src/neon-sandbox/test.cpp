@@ -1,8 +1,16 @@
 #include "test.hpp"
 
+#include "neon/group.hpp"
+#include "neon/instance.hpp"
 #include "neon/material.hpp"
+#include "neon/sampler.hpp"
 #include "neon/scene.hpp"
 #include "neon/sphere.hpp"
+#include "neon/trianglemesh.hpp"
+
+#include <algorithm>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <memory>
 
 // Factory function for simple test scene1
@@ -78,3 +86,141 @@ std::shared_ptr<ne::Scene> testScene2() {
 
   return scene;
 }
+
+// Factory function for the mesh test scene
+std::shared_ptr<ne::Scene> testScene3(const std::string &objFile) {
+  std::shared_ptr<ne::MeshData> mesh = ne::loadObj(objFile);
+  if (!mesh)
+    return testScene1();
+  if (mesh->normals.empty())
+    mesh->computeNormals();
+
+  // fit the mesh into the unit cube of the center sphere, standing on the
+  // ground
+  const ne::AABB box = mesh->bounds();
+  const glm::vec3 extent = box.extent();
+  const float scale =
+      1.0f / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+  glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, -1.0f));
+  m = glm::scale(m, glm::vec3(scale));
+  m = glm::translate(m, -glm::vec3(box.centroid().x, box.min.y,
+                                   box.centroid().z));
+  mesh->transform(m);
+
+  // Define materials
+  const ne::MaterialPointer mat1 =
+      std::make_shared<ne::Lambertian>(glm::vec3{0.8f, 0.3f, 0.3f});
+  const ne::MaterialPointer mat2 =
+      std::make_shared<ne::Lambertian>(glm::vec3{0.8f, 0.8f, 0.0f});
+  const ne::MaterialPointer mat3 =
+      std::make_shared<ne::Metal>(glm::vec3{0.8f, 0.6f, 0.2f});
+  const ne::MaterialPointer mat4 =
+      std::make_shared<ne::Dielectric>(glm::vec3{0.8f, 0.8f, 0.8f}, 1.5f);
+  const ne::MaterialPointer mat5 =
+      std::make_shared<ne::DiffuseLight>(glm::vec3{2.0, 2.0, 2.0});
+
+  // Define rendable geometries and bind materials
+  const ne::RendablePointer s1 = std::make_shared<ne::TriangleMesh>(mesh, mat1);
+  const ne::RendablePointer s2 =
+      std::make_shared<ne::Sphere>(glm::vec3(0, -100.5, -1), 100.f, mat2);
+  const ne::RendablePointer s3 =
+      std::make_shared<ne::Sphere>(glm::vec3(1, 0, -1), 0.5f, mat3);
+  const ne::RendablePointer s4 =
+      std::make_shared<ne::Sphere>(glm::vec3(-1, 0, -1), 0.5f, mat4);
+  const ne::RendablePointer s5 =
+      std::make_shared<ne::Sphere>(glm::vec3(0, 1, -1), 0.5f, mat5);
+
+  // Assemble the scene
+  std::shared_ptr<ne::Scene> scene = std::make_shared<ne::Scene>();
+  scene->add(s1);
+  scene->add(s2);
+  scene->add(s3);
+  scene->add(s4);
+  scene->add(s5);
+
+  return scene;
+}
+
+// Factory function for the instancing test scene
+std::shared_ptr<ne::Scene> testScene4(const std::string &objFile) {
+  const ne::MaterialPointer ground =
+      std::make_shared<ne::Lambertian>(glm::vec3(0.8f, 0.8f, 0.8f));
+  const ne::MaterialPointer leaves =
+      std::make_shared<ne::Lambertian>(glm::vec3(0.3f, 0.7f, 0.3f));
+  const ne::MaterialPointer fruit =
+      std::make_shared<ne::Metal>(glm::vec3(0.8f, 0.4f, 0.3f), 0.3f);
+  const ne::MaterialPointer light =
+      std::make_shared<ne::DiffuseLight>(glm::vec3(4.0f, 4.0f, 4.0f));
+
+  // shared geometry, standing on y = 0 in object space
+  ne::RendablePointer tree;
+  std::shared_ptr<ne::MeshData> mesh =
+      objFile.empty() ? nullptr : ne::loadObj(objFile);
+  if (mesh) {
+    if (mesh->normals.empty())
+      mesh->computeNormals();
+    const ne::AABB box = mesh->bounds();
+    const glm::vec3 extent = box.extent();
+    const float scale = 0.4f / std::max(std::max(extent.x, extent.y),
+                                        std::max(extent.z, 1e-6f));
+    mesh->transform(glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(scale)),
+                                   -glm::vec3(box.centroid().x, box.min.y,
+                                              box.centroid().z)));
+    tree = std::make_shared<ne::TriangleMesh>(mesh, leaves);
+  } else {
+    auto group = std::make_shared<ne::Group>();
+    group->add(std::make_shared<ne::Sphere>(glm::vec3(0, 0.10f, 0), 0.10f, leaves));
+    group->add(std::make_shared<ne::Sphere>(glm::vec3(0, 0.24f, 0), 0.08f, leaves));
+    group->add(std::make_shared<ne::Sphere>(glm::vec3(0, 0.35f, 0), 0.05f, leaves));
+    group->add(std::make_shared<ne::Sphere>(glm::vec3(0.09f, 0.14f, 0.04f), 0.03f, fruit));
+    group->build();
+    tree = group;
+  }
+
+  std::shared_ptr<ne::Scene> scene = std::make_shared<ne::Scene>();
+  scene->add(std::make_shared<ne::Sphere>(glm::vec3(0, -100.5, -1), 100.0f, ground));
+  scene->add(std::make_shared<ne::Sphere>(glm::vec3(0, 2.5f, -2), 0.8f, light));
+
+  // the same tree placed 400 times with a random turn and size
+  ne::Sampler sampler(7);
+  for (int j = 0; j < 20; ++j) {
+    for (int i = 0; i < 20; ++i) {
+      const glm::vec3 position(-4.0f + 0.42f * i, -0.5f, 1.0f - 0.45f * j);
+      glm::mat4 m = glm::translate(glm::mat4(1.0f), position);
+      m = glm::rotate(m, glm::two_pi<float>() * sampler.next1D(),
+                      glm::vec3(0, 1, 0));
+      m = glm::scale(m, glm::vec3(0.7f + 0.6f * sampler.next1D()));
+      scene->add(std::make_shared<ne::Instance>(tree, m));
+    }
+  }
+  return scene;
+}
+
+// Factory function for the many lights test scene
+std::shared_ptr<ne::Scene> testScene5(int numLights) {
+  const ne::MaterialPointer ground =
+      std::make_shared<ne::Lambertian>(glm::vec3(0.8f, 0.8f, 0.8f));
+  const ne::MaterialPointer diffuse =
+      std::make_shared<ne::Lambertian>(glm::vec3(0.8f, 0.3f, 0.3f));
+  const ne::MaterialPointer metal =
+      std::make_shared<ne::Metal>(glm::vec3(0.8f, 0.6f, 0.2f), 0.2f);
+  const ne::MaterialPointer light =
+      std::make_shared<ne::DiffuseLight>(glm::vec3(1.0f, 1.0f, 1.0f));
+
+  std::shared_ptr<ne::Scene> scene = std::make_shared<ne::Scene>();
+  scene->add(std::make_shared<ne::Sphere>(glm::vec3(0, -100.5, -1), 100.0f, ground));
+  for (int i = 0; i < 5; ++i) {
+    scene->add(std::make_shared<ne::Sphere>(glm::vec3(-2.0f + i, 0, -1), 0.4f,
+                                            i % 2 ? metal : diffuse));
+  }
+
+  // small lights hovering over the whole floor
+  ne::Sampler sampler(11);
+  for (int i = 0; i < numLights; ++i) {
+    const glm::vec3 position(-4.0f + 8.0f * sampler.next1D(),
+                             -0.3f + 1.8f * sampler.next1D(),
+                             -5.0f + 6.0f * sampler.next1D());
+    scene->add(std::make_shared<ne::Sphere>(position, 0.05f, light));
+  }
+  return scene;
+}
@@ -3,9 +3,16 @@
 
 #include "neon/scene.hpp"
 #include <memory>
+#include <string>
 
 /* Factory functions */
 std::shared_ptr<ne::Scene> testScene1(); // task 1,2,3
 std::shared_ptr<ne::Scene> testScene2(); // task 4
+// scene 1 with the center sphere replaced by an OBJ mesh
+std::shared_ptr<ne::Scene> testScene3(const std::string &objFile);
+// a field of instances of one shared group, or of an OBJ mesh if given
+std::shared_ptr<ne::Scene> testScene4(const std::string &objFile);
+// a few spheres lit by many small lights, for many-light sampling
+std::shared_ptr<ne::Scene> testScene5(int numLights);
 
 #endif // __TEST_H_
@@ -0,0 +1,80 @@
+#ifndef __AABB_H_
+#define __AABB_H_
+
+#include "neon/ray.hpp"
+
+#include <glm/glm.hpp>
+#include <limits>
+#include <utility>
+
+namespace ne {
+
+// Axis aligned bounding box. Default constructed box is empty (min > max) so
+// it can be grown with expand().
+struct AABB {
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+  AABB() {}
+  AABB(const glm::vec3 &lo, const glm::vec3 &hi) : min(lo), max(hi) {}
+
+  inline void expand(const glm::vec3 &p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+
+  inline void expand(const AABB &other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+
+  inline bool empty() const {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+  }
+
+  inline glm::vec3 extent() const { return max - min; }
+  inline glm::vec3 centroid() const { return 0.5f * (min + max); }
+
+  inline float surfaceArea() const {
+    if (empty())
+      return 0.0f;
+    const glm::vec3 d = extent();
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+
+  inline int longestAxis() const {
+    const glm::vec3 d = extent();
+    return (d.x > d.y && d.x > d.z) ? 0 : (d.y > d.z ? 1 : 2);
+  }
+
+  /// Slab test. invDir is 1 / ray.dir, precomputed once per ray. Returns the
+  /// entry distance in tNear when the box overlaps [0, tFar]. The exit
+  /// distance is widened by 1 + 2 * gamma(3) (Ize 2013) so rounding never
+  /// rejects a ray that grazes the box, e.g. along a shared triangle edge,
+  /// and a slab giving NaN (origin on the slab, direction parallel to it) is
+  /// treated as not limiting the ray.
+  inline bool hit(const glm::vec3 &o, const glm::vec3 &invDir, float tFar,
+                  float &tNear) const {
+    float tmin = -std::numeric_limits<float>::max();
+    float tmax = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; ++axis) {
+      float t0 = (min[axis] - o[axis]) * invDir[axis];
+      float t1 = (max[axis] - o[axis]) * invDir[axis];
+      if (t0 > t1)
+        std::swap(t0, t1);
+      // comparisons with NaN are false and keep the previous bound
+      tmin = t0 > tmin ? t0 : tmin;
+      tmax = t1 < tmax ? t1 : tmax;
+    }
+    tmax *= robustScale_;
+    tNear = tmin;
+    return tmax >= glm::max(tmin, 0.0f) && tmin <= tFar;
+  }
+
+  inline static constexpr float robustScale_ = 1.0f + 2.0f * 3.0f * 0.5f *
+                                               std::numeric_limits<float>::epsilon();
+};
+
+} // namespace ne
+
+#endif // __AABB_H_
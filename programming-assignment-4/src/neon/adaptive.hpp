@@ -0,0 +1,108 @@
+#ifndef __ADAPTIVE_H_
+#define __ADAPTIVE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace ne {
+
+// Running mean of a pixel's color and variance of its luminance (Welford).
+struct PixelEstimator {
+  glm::vec3 sum{0.0f};
+  double meanLuminance = 0.0;
+  double m2 = 0.0;
+  uint32_t count = 0;
+
+  inline void add(const glm::vec3 &sample) {
+    sum += sample;
+    const double y =
+        0.2126 * sample.r + 0.7152 * sample.g + 0.0722 * sample.b;
+    ++count;
+    const double delta = y - meanLuminance;
+    meanLuminance += delta / count;
+    m2 += delta * (y - meanLuminance);
+  }
+
+  inline glm::vec3 mean() const {
+    return count > 0 ? sum / float(count) : glm::vec3(0.0f);
+  }
+
+  /// standard error of the mean luminance relative to the luminance. The
+  /// offset keeps almost black pixels from soaking up the whole budget.
+  inline float relativeError() const {
+    if (count < 2)
+      return std::numeric_limits<float>::max();
+    const double variance = m2 / (count - 1);
+    return static_cast<float>(std::sqrt(variance / count) /
+                              (meanLuminance + darkOffset_));
+  }
+
+  inline static constexpr double darkOffset_ = 0.05;
+};
+
+struct AdaptiveSettings {
+  int minSpp = 16;         // samples every pixel gets before it is judged
+  int maxSpp = 1024;       // cap for a single pixel
+  int batch = 8;           // samples added to an unconverged pixel per pass
+  float threshold = 0.02f; // relative error at which a pixel is done
+};
+
+// Spends a budget of sppBudget * numPixels samples on a group of pixels
+// (typically a tile). After minSpp samples everywhere, converged pixels stop
+// and the rest of the budget goes to the noisiest pixels first, in passes of
+// `batch` samples. sample(p) must return one radiance sample of pixel p.
+template <typename SampleFn>
+void renderAdaptive(uint32_t numPixels, int sppBudget,
+                    const AdaptiveSettings &settings, SampleFn &&sample,
+                    std::vector<ne::PixelEstimator> &estimators) {
+  estimators.assign(numPixels, ne::PixelEstimator());
+  const uint64_t budget = uint64_t(std::max(sppBudget, 0)) * numPixels;
+  const uint32_t minSpp = static_cast<uint32_t>(std::max(settings.minSpp, 1));
+  const uint32_t maxSpp = std::max(static_cast<uint32_t>(settings.maxSpp), minSpp);
+  const uint32_t batch = static_cast<uint32_t>(std::max(settings.batch, 1));
+
+  uint64_t used = 0;
+  for (uint32_t p = 0; p < numPixels; ++p) {
+    for (uint32_t s = 0; s < minSpp; ++s)
+      estimators[p].add(sample(p));
+    used += minSpp;
+  }
+
+  std::vector<uint32_t> active(numPixels);
+  std::iota(active.begin(), active.end(), 0u);
+  auto done = [&](uint32_t p) {
+    return estimators[p].count >= maxSpp ||
+           estimators[p].relativeError() < settings.threshold;
+  };
+
+  while (used < budget) {
+    active.erase(std::remove_if(active.begin(), active.end(), done),
+                 active.end());
+    if (active.empty())
+      break;
+
+    // noisiest first, in case the budget runs out during this pass
+    std::sort(active.begin(), active.end(), [&](uint32_t a, uint32_t b) {
+      return estimators[a].relativeError() > estimators[b].relativeError();
+    });
+
+    for (uint32_t p : active) {
+      const uint64_t n = std::min<uint64_t>(
+          {batch, maxSpp - estimators[p].count, budget - used});
+      for (uint64_t s = 0; s < n; ++s)
+        estimators[p].add(sample(p));
+      used += n;
+      if (used >= budget)
+        break;
+    }
+  }
+}
+
+} // namespace ne
+
+#endif // __ADAPTIVE_H_
@@ -0,0 +1,188 @@
+#include "neon/aov.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+namespace ne {
+
+namespace {
+
+constexpr size_t cacheLine = 64;
+
+// black, red, yellow, white for v in [0, 1]
+glm::u8vec4 heat(float v) {
+  v = glm::clamp(v, 0.0f, 1.0f);
+  const glm::vec3 c = glm::clamp(glm::vec3(3.0f * v, 3.0f * v - 1.0f,
+                                           3.0f * v - 2.0f),
+                                 0.0f, 1.0f);
+  return glm::u8vec4(c * 255.99f, 255);
+}
+
+// value below which 99% of the values lie, at least 1
+template <typename T> T percentile99(std::vector<T> values) {
+  if (values.empty())
+    return T(1);
+  const size_t k = (values.size() - 1) * 99 / 100;
+  std::nth_element(values.begin(), values.begin() + k, values.end());
+  return std::max(values[k], T(1));
+}
+
+} // namespace
+
+AovBuffer::AovBuffer(const std::vector<ne::TileIterator> &tiles,
+                     glm::uvec2 size)
+    : size_(size), tiles_(tiles) {
+  if (tiles.empty())
+    return;
+  tileSize_ = glm::max(tiles[0].endIndex() - tiles[0].startIndex(),
+                       glm::uvec2(1));
+  numTiles_ = (size + tileSize_ - 1u) / tileSize_;
+
+  // every tile starts on a cache line: 4 pixels are 3 lines
+  constexpr size_t group = 4;
+  static_assert(group * sizeof(AovPixel) % cacheLine == 0,
+                "tiles would not start on a cache line");
+  size_t numPixels = 0;
+  for (const ne::TileIterator &tile : tiles) {
+    tileOffset_.push_back(numPixels);
+    tileWidth_.push_back(tile.endIndex().x - tile.startIndex().x);
+    numPixels += (tile.numPixels() + group - 1) / group * group;
+  }
+
+  // operator new aligns to 16 bytes, at most 3 pixels reach the next line
+  storage_.resize(numPixels + group - 1);
+  const uintptr_t address = reinterpret_cast<uintptr_t>(storage_.data());
+  while ((address + align_ * sizeof(AovPixel)) % cacheLine != 0 &&
+         align_ < group - 1)
+    ++align_;
+}
+
+void AovBuffer::clear() {
+  std::fill(storage_.begin(), storage_.end(), AovPixel());
+}
+
+void AovBuffer::film(AovChannel channel, ne::Film &out) const {
+  if (out.size() != size_)
+    out = ne::Film(size_);
+  else
+    out.clear();
+  for (const ne::TileIterator &tile : tiles_) {
+    for (const glm::uvec2 &index : tile) {
+      const AovPixel &p = (*this)(index);
+      if (channel == AovChannel::Normal)
+        out.add(index, p.normal, p.samples);
+      else if (channel == AovChannel::Albedo)
+        out.add(index, p.albedo, p.samples);
+      else if (channel == AovChannel::Depth)
+        out.add(index, glm::vec3(p.depth), p.hits);
+    }
+  }
+}
+
+void AovBuffer::save(const std::string &prefix) const {
+  // heatmap scales
+  std::vector<uint64_t> times;
+  std::vector<uint32_t> samples;
+  float maxDepth = 0.0f;
+  for (const ne::TileIterator &tile : tiles_) {
+    for (const glm::uvec2 &index : tile) {
+      const AovPixel &p = (*this)(index);
+      times.push_back(p.time);
+      samples.push_back(p.samples);
+      if (p.hits > 0)
+        maxDepth = std::max(maxDepth, p.depth / p.hits);
+    }
+  }
+  const float timeScale = 1.0f / float(percentile99(std::move(times)));
+  const float sampleScale = 1.0f / float(percentile99(std::move(samples)));
+
+  ne::Image depth(size_), normal(size_), albedo(size_), material(size_),
+      count(size_), time(size_);
+  const glm::u8vec4 black(0, 0, 0, 255);
+  for (const ne::TileIterator &tile : tiles_) {
+    for (const glm::uvec2 &index : tile) {
+      const AovPixel &p = (*this)(index);
+      const float n = float(std::max(p.samples, 1u));
+
+      depth(index) = black;
+      if (p.hits > 0 && maxDepth > 0.0f) {
+        const float v = 1.0f - p.depth / p.hits / maxDepth;
+        depth(index) = glm::u8vec4(glm::u8vec3(255.99f * v), 255);
+      }
+
+      normal(index) = black;
+      const float length = glm::length(p.normal);
+      if (length > 0.0f)
+        normal(index) = glm::u8vec4(
+            (p.normal / length * 0.5f + 0.5f) * 255.99f, 255);
+
+      albedo(index) = glm::u8vec4(
+          glm::clamp(p.albedo / n, 0.0f, 1.0f) * 255.99f, 255);
+
+      // hash the id into a bright color
+      material(index) = black;
+      if (p.materialId > 0) {
+        const uint32_t h = p.materialId * 2654435761u;
+        material(index) = glm::u8vec4(64 + (h >> 24) % 192,
+                                      64 + (h >> 16) % 192,
+                                      64 + (h >> 8) % 192, 255);
+      }
+
+      count(index) = heat(p.samples * sampleScale);
+      time(index) = heat(p.time * timeScale);
+    }
+  }
+
+  depth.save((prefix + "_depth.png").c_str());
+  normal.save((prefix + "_normal.png").c_str());
+  albedo.save((prefix + "_albedo.png").c_str());
+  material.save((prefix + "_material.png").c_str());
+  count.save((prefix + "_samples.png").c_str());
+  time.save((prefix + "_time.png").c_str());
+}
+
+void AovBuffer::report(std::ostream &out, size_t numTiles) const {
+  std::vector<uint64_t> tileTime(tiles_.size(), 0);
+  uint64_t total = 0, maxTime = 0;
+  glm::uvec2 maxIndex(0);
+  for (size_t t = 0; t < tiles_.size(); ++t) {
+    for (const glm::uvec2 &index : tiles_[t]) {
+      const uint64_t time = (*this)(index).time;
+      tileTime[t] += time;
+      if (time > maxTime) {
+        maxTime = time;
+        maxIndex = index;
+      }
+    }
+    total += tileTime[t];
+  }
+
+  char line[128];
+  const uint64_t numPixels = uint64_t(size_.x) * size_.y;
+  std::snprintf(line, sizeof(line),
+                "pixel time: total %.3f s, mean %.0f ns, max %llu ns at "
+                "(%u, %u)\n",
+                total * 1e-9, double(total) / std::max<uint64_t>(numPixels, 1),
+                (unsigned long long)maxTime, maxIndex.x, maxIndex.y);
+  out << line;
+
+  std::vector<uint32_t> order(tiles_.size());
+  std::iota(order.begin(), order.end(), 0u);
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return tileTime[a] > tileTime[b];
+  });
+  std::snprintf(line, sizeof(line), "%6s %12s %12s %7s\n", "tile", "start",
+                "ns/pixel", "share");
+  out << line;
+  for (size_t i = 0; i < std::min(numTiles, order.size()); ++i) {
+    const ne::TileIterator &tile = tiles_[order[i]];
+    std::snprintf(line, sizeof(line), "%6u %5u, %5u %12.0f %6.1f%%\n",
+                  order[i], tile.startIndex().x, tile.startIndex().y,
+                  double(tileTime[order[i]]) / std::max(tile.numPixels(), 1u),
+                  100.0 * tileTime[order[i]] / std::max<uint64_t>(total, 1));
+    out << line;
+  }
+}
+
+} // namespace ne
@@ -0,0 +1,108 @@
+#ifndef __AOV_H_
+#define __AOV_H_
+
+#include "neon/film.hpp"
+#include "neon/image.hpp"
+#include "neon/integrator.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ne {
+
+enum class AovChannel { Depth, Normal, Albedo, MaterialId, SampleCount, Time };
+
+// All channels of one pixel, summed over its samples. 48 bytes, 4 pixels
+// fill 3 cache lines, so tiles and the pieces the scheduler cuts them into
+// start on a line.
+struct AovPixel {
+  glm::vec3 normal{0.0f};
+  glm::vec3 albedo{0.0f};
+  float depth = 0.0f;      // sum over the samples that hit something
+  uint32_t hits = 0;       // samples that hit something
+  uint32_t samples = 0;
+  uint32_t materialId = 0; // first material hit + 1, 0 if none was
+  uint64_t time = 0;       // nanoseconds spent on the pixel
+};
+
+// Arbitrary output variables: per pixel channels written next to the color.
+// Storage is allocated once and laid out tile by tile. Every tile is a
+// contiguous, cache line aligned block of rows, so threads rendering
+// different tiles, or different pieces of one tile, do not share cache
+// lines. Tiles have to come from Image::toTiles.
+class AovBuffer {
+public:
+  AovBuffer() = default;
+  AovBuffer(const std::vector<ne::TileIterator> &tiles, glm::uvec2 size);
+
+  AovBuffer(const AovBuffer &) = delete;
+  AovBuffer &operator=(const AovBuffer &) = delete;
+  AovBuffer(AovBuffer &&) = default;
+  AovBuffer &operator=(AovBuffer &&) = default;
+
+  bool empty() const { return storage_.empty(); }
+  glm::uvec2 size() const { return size_; }
+
+  inline AovPixel &operator()(const glm::uvec2 index) {
+    return base()[offset(index)];
+  }
+  inline const AovPixel &operator()(const glm::uvec2 index) const {
+    return base()[offset(index)];
+  }
+
+  /// Add count samples of a pixel. sum holds the sum of their first hits,
+  /// materialId the scene's index of sum.material, time their cost in ns.
+  inline void add(const glm::uvec2 index, const ne::core::FirstHit &sum,
+                  uint32_t count, uint32_t materialId, uint64_t time) {
+    AovPixel &p = (*this)(index);
+    p.normal += sum.normal;
+    p.albedo += sum.albedo;
+    p.depth += sum.depth;
+    p.hits += static_cast<uint32_t>(sum.hits);
+    if (p.materialId == 0 && sum.material)
+      p.materialId = materialId + 1;
+    p.samples += count;
+    p.time += time;
+  }
+
+  void clear();
+
+  /// mean normal, albedo or depth as a Film, e.g. to guide ne::Denoiser
+  void film(AovChannel channel, ne::Film &out) const;
+
+  /// Develop every channel in one sweep over the tiles and save each as
+  /// <prefix>_<channel>.png. Depth is white near the camera, material ids get
+  /// arbitrary colors, sample count and time are heatmaps scaled to their
+  /// 99th percentile, which a first sweep finds.
+  void save(const std::string &prefix) const;
+
+  /// total and per pixel time and the most expensive tiles
+  void report(std::ostream &out, size_t numTiles = 5) const;
+
+private:
+  inline size_t offset(const glm::uvec2 index) const {
+    const glm::uvec2 cell = index / tileSize_;
+    const uint32_t tile = cell.x + cell.y * numTiles_.x;
+    const glm::uvec2 local = index - cell * tileSize_;
+    return tileOffset_[tile] + local.x + size_t(local.y) * tileWidth_[tile];
+  }
+
+  AovPixel *base() { return storage_.data() + align_; }
+  const AovPixel *base() const { return storage_.data() + align_; }
+
+  glm::uvec2 size_{0};
+  glm::uvec2 tileSize_{1};
+  glm::uvec2 numTiles_{0};
+  std::vector<ne::TileIterator> tiles_;
+  std::vector<size_t> tileOffset_;  // first pixel of every tile
+  std::vector<uint32_t> tileWidth_; // pixels per row of every tile
+  std::vector<AovPixel> storage_;
+  size_t align_ = 0; // first pixel of storage_ on a cache line
+};
+
+} // namespace ne
+
+#endif // __AOV_H_
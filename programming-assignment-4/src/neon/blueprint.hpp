@@ -19,13 +19,19 @@ class Integrator;
 class Image;
 class TileIterator;
 class Sphere;
+class TriangleMesh;
+struct MeshData;
+class Group;
+class Instance;
 class Intersection;
 class Ray;
+struct RayPacket;
 class Metal;
 class Lambertian;
 class DiffuseLight;
 class Camera;
 class Scene;
+class Sampler;
 
 // alias
 using MaterialPointer = std::shared_ptr<ne::abstract::Material>;
@@ -0,0 +1,369 @@
+#include "neon/bvh.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <taskflow/taskflow.hpp>
+
+namespace ne {
+
+void BVH::clear() {
+  nodes_.clear();
+  indices_.clear();
+  parents_.clear();
+  leafOf_.clear();
+  weightedArea_ = 0.0;
+}
+
+namespace {
+
+// spreads the low 10 bits of v to every third bit
+uint32_t expandBits(uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// 30 bit Morton code of p within box, x in the highest bit of each triple
+uint32_t morton3(const glm::vec3 &p, const ne::AABB &box) {
+  const glm::vec3 extent = glm::max(box.extent(), glm::vec3(1e-30f));
+  const glm::vec3 q =
+      glm::clamp((p - box.min) / extent * 1024.0f, glm::vec3(0.0f),
+                 glm::vec3(1023.0f));
+  return expandBits(static_cast<uint32_t>(q.x)) << 2 |
+         expandBits(static_cast<uint32_t>(q.y)) << 1 |
+         expandBits(static_cast<uint32_t>(q.z));
+}
+
+} // namespace
+
+struct BVH::BuildContext {
+  const std::vector<ne::AABB> &bounds;
+  std::vector<glm::vec3> centroids;
+  std::vector<uint32_t> codes; // Morton code of indices_[i], sorted
+  uint32_t maxLeafSize;
+  ne::BvhBuilder builder;
+};
+
+// Explicitly linked node of the parallel build. Ranges below taskSize_ are
+// built by one task straight into subtree, in the final depth first order.
+struct BVH::BuildNode {
+  Node node;
+  std::unique_ptr<BuildNode> children[2];
+  std::vector<Node> subtree;
+};
+
+void BVH::build(const std::vector<ne::AABB> &bounds, uint32_t maxLeafSize,
+                ne::BvhBuilder builder, unsigned numThreads) {
+  clear();
+  if (bounds.empty())
+    return;
+
+  const uint32_t n = static_cast<uint32_t>(bounds.size());
+  indices_.resize(n);
+  std::iota(indices_.begin(), indices_.end(), 0u);
+
+  BuildContext context{bounds, std::vector<glm::vec3>(n), {},
+                       std::max(1u, std::min(maxLeafSize, 0xffffu)), builder};
+  ne::AABB centroidBounds;
+  for (uint32_t i = 0; i < n; ++i) {
+    context.centroids[i] = bounds[i].centroid();
+    centroidBounds.expand(context.centroids[i]);
+  }
+
+  if (builder == ne::BvhBuilder::Morton) {
+    std::vector<uint64_t> keys(n);
+    for (uint32_t i = 0; i < n; ++i)
+      keys[i] = uint64_t(morton3(context.centroids[i], centroidBounds)) << 32 |
+                i;
+    std::sort(keys.begin(), keys.end());
+    context.codes.resize(n);
+    for (uint32_t i = 0; i < n; ++i) {
+      indices_[i] = static_cast<uint32_t>(keys[i]);
+      context.codes[i] = static_cast<uint32_t>(keys[i] >> 32);
+    }
+  }
+
+  if (numThreads <= 1 || n < taskSize_) {
+    // a full binary tree has at most 2n - 1 nodes
+    nodes_.reserve(2 * bounds.size() - 1);
+    buildRecursive(context, 0, n, 0, nodes_);
+  } else {
+    BuildNode root;
+    tf::Taskflow taskflow(numThreads);
+    taskflow.emplace([&](tf::SubflowBuilder &subflow) {
+      buildParallel(context, subflow, root, 0, n, 0);
+    });
+    taskflow.wait_for_all();
+    nodes_.reserve(2 * bounds.size() - 1);
+    flatten(root);
+  }
+  nodes_.shrink_to_fit();
+
+  for (const Node &node : nodes_)
+    weightedArea_ += double(node.bounds.surfaceArea()) *
+                     (node.count > 0 ? double(node.count) : 1.0);
+}
+
+bool BVH::split(const BuildContext &context, uint32_t begin, uint32_t end,
+                int depth, ne::AABB &nodeBounds, uint32_t &mid, int &axis) {
+  const std::vector<ne::AABB> &bounds = context.bounds;
+  const std::vector<glm::vec3> &centroids = context.centroids;
+  const uint32_t maxLeafSize = context.maxLeafSize;
+
+  for (uint32_t i = begin; i < end; ++i)
+    nodeBounds.expand(bounds[indices_[i]]);
+
+  // leave room on the traversal stack
+  const uint32_t count = end - begin;
+  if (count == 1 || depth >= stackSize_ - 2)
+    return false;
+
+  if (context.builder == ne::BvhBuilder::Morton) {
+    if (count <= maxLeafSize)
+      return false;
+    // split where the highest differing bit of the sorted codes flips
+    const uint32_t first = context.codes[begin];
+    const uint32_t diff = first ^ context.codes[end - 1];
+    if (diff == 0) {
+      // duplicate codes, halve the range
+      axis = nodeBounds.longestAxis();
+      mid = begin + count / 2;
+      return true;
+    }
+    int bit = 31;
+    while (!(diff & (1u << bit)))
+      --bit;
+    const uint32_t mask = 1u << bit;
+    mid = static_cast<uint32_t>(
+        std::partition_point(context.codes.begin() + begin,
+                             context.codes.begin() + end,
+                             [&](uint32_t code) { return !(code & mask); }) -
+        context.codes.begin());
+    axis = 2 - bit % 3;
+    return true;
+  }
+
+  // find the cheapest split among all axes with binned SAH
+  struct Bin {
+    ne::AABB bounds;
+    uint32_t count = 0;
+  };
+
+  ne::AABB centroidBounds;
+  for (uint32_t i = begin; i < end; ++i)
+    centroidBounds.expand(centroids[indices_[i]]);
+  const glm::vec3 cExtent = centroidBounds.extent();
+  float bestCost = std::numeric_limits<float>::max();
+  int bestAxis = -1;
+  int bestSplit = 0;
+
+  for (int a = 0; a < 3; ++a) {
+    if (cExtent[a] <= 0.0f)
+      continue;
+
+    Bin bins[numBins_];
+    const float scale = numBins_ / cExtent[a];
+    for (uint32_t i = begin; i < end; ++i) {
+      const uint32_t prim = indices_[i];
+      int b = static_cast<int>((centroids[prim][a] - centroidBounds.min[a]) *
+                               scale);
+      b = std::min(b, numBins_ - 1);
+      bins[b].count++;
+      bins[b].bounds.expand(bounds[prim]);
+    }
+
+    // sweep from the right to get suffix areas, then from the left
+    float rightArea[numBins_];
+    uint32_t rightCount[numBins_];
+    ne::AABB acc;
+    uint32_t n = 0;
+    for (int b = numBins_ - 1; b > 0; --b) {
+      acc.expand(bins[b].bounds);
+      n += bins[b].count;
+      rightArea[b] = acc.surfaceArea();
+      rightCount[b] = n;
+    }
+
+    acc = ne::AABB();
+    n = 0;
+    for (int b = 0; b < numBins_ - 1; ++b) {
+      acc.expand(bins[b].bounds);
+      n += bins[b].count;
+      const float cost =
+          acc.surfaceArea() * n + rightArea[b + 1] * rightCount[b + 1];
+      if (n > 0 && rightCount[b + 1] > 0 && cost < bestCost) {
+        bestCost = cost;
+        bestAxis = a;
+        bestSplit = b;
+      }
+    }
+  }
+
+  const float area = nodeBounds.surfaceArea();
+  const float leafCost = static_cast<float>(count);
+  const float splitCost = area > 0.0f ? 1.0f + bestCost / area : leafCost;
+
+  if (bestAxis < 0) {
+    // all centroids coincide, SAH can not separate them
+    if (count <= maxLeafSize)
+      return false;
+    axis = nodeBounds.longestAxis();
+    mid = begin + count / 2;
+    return true;
+  }
+  if (count <= maxLeafSize && leafCost <= splitCost)
+    return false;
+
+  const float lo = centroidBounds.min[bestAxis];
+  const float scale = numBins_ / cExtent[bestAxis];
+  auto *first = indices_.data() + begin;
+  auto *pivot =
+      std::partition(first, indices_.data() + end, [&](uint32_t prim) {
+        int b = static_cast<int>((centroids[prim][bestAxis] - lo) * scale);
+        return std::min(b, numBins_ - 1) <= bestSplit;
+      });
+  mid = static_cast<uint32_t>(pivot - indices_.data());
+  if (mid == begin || mid == end)
+    mid = begin + count / 2;
+  axis = bestAxis;
+  return true;
+}
+
+uint32_t BVH::buildRecursive(const BuildContext &context, uint32_t begin,
+                             uint32_t end, int depth,
+                             std::vector<Node> &nodes) {
+  const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+  nodes.emplace_back();
+
+  ne::AABB nodeBounds;
+  uint32_t mid = 0;
+  int axis = 0;
+  if (!split(context, begin, end, depth, nodeBounds, mid, axis)) {
+    Node &node = nodes[nodeIndex];
+    node.bounds = nodeBounds;
+    node.offset = begin;
+    node.count = static_cast<uint16_t>(end - begin);
+    node.axis = 0;
+    return nodeIndex;
+  }
+
+  buildRecursive(context, begin, mid, depth + 1, nodes);
+  const uint32_t right = buildRecursive(context, mid, end, depth + 1, nodes);
+
+  Node &node = nodes[nodeIndex];
+  node.bounds = nodeBounds;
+  node.offset = right;
+  node.count = 0;
+  node.axis = static_cast<uint16_t>(axis);
+  return nodeIndex;
+}
+
+template <typename Subflow>
+void BVH::buildParallel(const BuildContext &context, Subflow &subflow,
+                        BuildNode &out, uint32_t begin, uint32_t end,
+                        int depth) {
+  // subtree offsets are relative to its root until flatten()
+  if (end - begin < taskSize_) {
+    buildRecursive(context, begin, end, depth, out.subtree);
+    return;
+  }
+
+  ne::AABB nodeBounds;
+  uint32_t mid = 0;
+  int axis = 0;
+  if (!split(context, begin, end, depth, nodeBounds, mid, axis)) {
+    out.subtree.push_back(
+        {nodeBounds, begin, static_cast<uint16_t>(end - begin), 0});
+    return;
+  }
+  out.node = {nodeBounds, 0, 0, static_cast<uint16_t>(axis)};
+
+  // both halves only touch their own part of indices_
+  const uint32_t ranges[2][2] = {{begin, mid}, {mid, end}};
+  for (int c = 0; c < 2; ++c) {
+    out.children[c] = std::make_unique<BuildNode>();
+    BuildNode *child = out.children[c].get();
+    const uint32_t first = ranges[c][0], last = ranges[c][1];
+    subflow.emplace([this, &context, child, first, last,
+                     depth](tf::SubflowBuilder &childflow) {
+      buildParallel(context, childflow, *child, first, last, depth + 1);
+    });
+  }
+}
+
+uint32_t BVH::flatten(const BuildNode &node) {
+  const uint32_t base = static_cast<uint32_t>(nodes_.size());
+  if (!node.subtree.empty()) {
+    for (Node n : node.subtree) {
+      if (n.count == 0)
+        n.offset += base;
+      nodes_.push_back(n);
+    }
+    return base;
+  }
+  nodes_.push_back(node.node);
+  flatten(*node.children[0]);
+  const uint32_t right = flatten(*node.children[1]);
+  nodes_[base].offset = right;
+  return base;
+}
+
+void BVH::relocateLeaves(const std::vector<uint32_t> &first) {
+  std::vector<uint32_t> indices(indices_.size());
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    Node &node = nodes_[i];
+    if (node.count == 0)
+      continue;
+    std::copy(indices_.begin() + node.offset,
+              indices_.begin() + node.offset + node.count,
+              indices.begin() + first[i]);
+    node.offset = first[i];
+  }
+  indices_.swap(indices);
+  // leafOf_ is stale, the next refit links again
+  parents_.clear();
+  leafOf_.clear();
+}
+
+float BVH::sahCost() const {
+  if (nodes_.empty())
+    return 0.0f;
+
+  const float rootArea = nodes_[0].bounds.surfaceArea();
+  if (rootArea <= 0.0f)
+    return 0.0f;
+
+  return static_cast<float>(weightedArea_ / rootArea);
+}
+
+void BVH::linkParents() {
+  parents_.assign(nodes_.size(), 0);
+  leafOf_.assign(indices_.size(), 0);
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    const Node &node = nodes_[i];
+    if (node.count > 0) {
+      for (uint32_t k = 0; k < node.count; ++k)
+        leafOf_[node.offset + k] = i;
+    } else {
+      parents_[i + 1] = i;
+      parents_[node.offset] = i;
+    }
+  }
+}
+
+bool BVH::setBounds(uint32_t index, const ne::AABB &box) {
+  Node &node = nodes_[index];
+  if (box.min == node.bounds.min && box.max == node.bounds.max)
+    return false;
+  const double cost = node.count > 0 ? double(node.count) : 1.0;
+  weightedArea_ +=
+      (double(box.surfaceArea()) - double(node.bounds.surfaceArea())) * cost;
+  node.bounds = box;
+  return true;
+}
+
+} // namespace ne
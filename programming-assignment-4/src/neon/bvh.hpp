@@ -0,0 +1,307 @@
+#ifndef __BVH_H_
+#define __BVH_H_
+
+#include "neon/aabb.hpp"
+#include "neon/ray.hpp"
+#include "neon/raypacket.hpp"
+#include "neon/stats.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace ne {
+
+// How BVH::build() chooses its splits.
+enum class BvhBuilder {
+  BinnedSah, // binned surface area heuristic, best trees
+  Morton     // LBVH: splits at Morton code bits, fast builds for dynamic use
+};
+
+// Bounding volume hierarchy over an arbitrary set of primitives, built with
+// the binned surface area heuristic. The BVH only knows primitive bounds; the
+// owner reorders its primitives with indices() after build() so that every
+// leaf covers a contiguous range, and supplies the actual primitive test to
+// intersect() as a callback.
+class BVH {
+public:
+  // 32 byte node. Children of an interior node are stored at (this + 1) and
+  // at offset, i.e. nodes are laid out in depth first order.
+  struct Node {
+    AABB bounds;
+    uint32_t offset; // leaf: first primitive, interior: second child
+    uint16_t count;  // number of primitives, 0 for interior nodes
+    uint16_t axis;   // split axis, used for front to back traversal
+  };
+
+  /// Build hierarchy from primitive bounds. Previous data is discarded. With
+  /// numThreads > 1 the subtrees of large nodes are built as Taskflow
+  /// subflows; the resulting tree is the same as with one thread.
+  void build(const std::vector<ne::AABB> &bounds, uint32_t maxLeafSize = 4,
+             ne::BvhBuilder builder = ne::BvhBuilder::BinnedSah,
+             unsigned numThreads = 1);
+
+  void clear();
+  bool empty() const { return nodes_.empty(); }
+
+  const std::vector<Node> &nodes() const { return nodes_; }
+
+  /// Permutation applied during build. Leaf ranges refer to positions in
+  /// this array: primitive i of the leaf is indices()[offset + i].
+  const std::vector<uint32_t> &indices() const { return indices_; }
+
+  /// Move the primitives of every leaf n to positions [first[n], first[n] +
+  /// count), e.g. so that leaves of one wide node are neighbours (see
+  /// ne::BVH8). The new ranges must cover every position once; interior
+  /// entries of first are ignored. Call before the owner applies indices().
+  void relocateLeaves(const std::vector<uint32_t> &first);
+
+  /// SAH cost of the tree (traversal cost 1, intersection cost 1). Kept up
+  /// to date by refit(), so it is cheap to query every frame.
+  float sahCost() const;
+
+  /// Refit after primitives moved, keeping the topology. changed lists
+  /// positions in indices() whose primitive has new bounds, bounds(p) returns
+  /// the current bounds of the primitive at position p. Only the leaves of
+  /// changed primitives and their ancestors are visited, and a walk stops at
+  /// the first node whose bounds stay the same.
+  template <typename BoundsFn>
+  void refit(const std::vector<uint32_t> &changed, BoundsFn &&bounds);
+
+  /// Closest hit traversal. leaf(first, count, ray) must test the primitives
+  /// in [first, first + count), shrink ray.t on hit and return whether it hit
+  /// anything. Children are visited front to back so ray.t culls the rest.
+  template <typename LeafFn> bool intersect(ne::Ray &ray, LeafFn &&leaf) const;
+
+  /// Any hit traversal for shadow rays. leaf(first, count, ray) returns true
+  /// as soon as one primitive blocks the segment [0, ray.t], which ends the
+  /// traversal immediately.
+  template <typename LeafFn>
+  bool occluded(const ne::Ray &ray, LeafFn &&leaf) const;
+
+  /// Closest hit traversal of the lanes in mask of a ray packet. Every node
+  /// is fetched once for the whole packet, culled against the packet bounds
+  /// and then tested per lane; children only see the lanes that hit their
+  /// parent. leaf(first, count, packet, lanes) tests the primitives against
+  /// lanes, shrinks packet.rays[i].t (and calls packet.updateT(i)) on hit and
+  /// returns the lanes that hit. Packets whose direction signs differ fall
+  /// back to one traversal per ray. Returns the lanes that hit.
+  template <typename LeafFn>
+  uint32_t intersect(ne::RayPacket &packet, uint32_t mask,
+                     LeafFn &&leaf) const;
+
+private:
+  template <typename LeafFn>
+  uint32_t intersectCoherent(ne::RayPacket &packet, uint32_t mask,
+                             LeafFn &leaf) const;
+
+  struct BuildContext;
+  struct BuildNode;
+
+  // bounds of [begin, end) and, unless it becomes a leaf, the split position
+  // and axis; reorders indices_ within the range
+  bool split(const BuildContext &context, uint32_t begin, uint32_t end,
+             int depth, ne::AABB &nodeBounds, uint32_t &mid, int &axis);
+  // depth first into nodes, returns the index of the subtree root
+  uint32_t buildRecursive(const BuildContext &context, uint32_t begin,
+                          uint32_t end, int depth, std::vector<Node> &nodes);
+  template <typename Subflow>
+  void buildParallel(const BuildContext &context, Subflow &subflow,
+                     BuildNode &out, uint32_t begin, uint32_t end, int depth);
+  uint32_t flatten(const BuildNode &node);
+
+  // parent of every node and leaf of every position, made by the first refit
+  void linkParents();
+  // false when box equals the current bounds of the node
+  bool setBounds(uint32_t index, const ne::AABB &box);
+
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> indices_;
+  std::vector<uint32_t> parents_;
+  std::vector<uint32_t> leafOf_;
+  // sum of node area times node cost, sahCost() without the root division
+  double weightedArea_ = 0.0;
+
+  inline static constexpr int numBins_ = 16;
+  inline static constexpr int stackSize_ = 64;
+  // ranges at least this large are split into parallel tasks
+  inline static constexpr uint32_t taskSize_ = 4096;
+};
+
+template <typename LeafFn>
+bool BVH::intersect(ne::Ray &ray, LeafFn &&leaf) const {
+  if (nodes_.empty())
+    return false;
+
+  const glm::vec3 invDir = 1.0f / ray.dir;
+  const bool dirIsNeg[3] = {invDir.x < 0.0f, invDir.y < 0.0f, invDir.z < 0.0f};
+
+  uint32_t stack[stackSize_];
+  int top = 0;
+  uint32_t current = 0;
+  bool found = false;
+  ne::stats::Tally<ne::stats::Counter::NodeVisits> visits;
+  ne::stats::Tally<ne::stats::Counter::PrimitiveTests> tests;
+
+  while (true) {
+    const Node &node = nodes_[current];
+    visits += 1;
+    float tNear;
+    if (node.bounds.hit(ray.o, invDir, ray.t, tNear)) {
+      if (node.count > 0) {
+        tests += node.count;
+        found = leaf(node.offset, node.count, ray) || found;
+      } else {
+        // visit near child first, defer the far one
+        if (dirIsNeg[node.axis]) {
+          stack[top++] = current + 1;
+          current = node.offset;
+        } else {
+          stack[top++] = node.offset;
+          current = current + 1;
+        }
+        continue;
+      }
+    }
+    if (top == 0)
+      break;
+    current = stack[--top];
+  }
+  return found;
+}
+
+template <typename LeafFn>
+uint32_t BVH::intersect(ne::RayPacket &packet, uint32_t mask,
+                        LeafFn &&leaf) const {
+  if (nodes_.empty() || mask == 0)
+    return 0;
+  // a single lane is cheaper on the single ray path
+  if ((mask & (mask - 1)) != 0 && packet.coherent(mask))
+    return intersectCoherent(packet, mask, leaf);
+
+  uint32_t found = 0;
+  for (int i = 0; i < ne::RayPacket::width; ++i) {
+    if (!(mask & (1u << i)))
+      continue;
+    const uint32_t lane = 1u << i;
+    if (intersect(packet.rays[i], [&](uint32_t first, uint32_t count,
+                                      ne::Ray &) {
+          return leaf(first, count, packet, lane) != 0;
+        }))
+      found |= lane;
+  }
+  return found;
+}
+
+template <typename LeafFn>
+uint32_t BVH::intersectCoherent(ne::RayPacket &packet, uint32_t mask,
+                                LeafFn &leaf) const {
+  const ne::PacketFrustum frustum(packet, mask);
+  const bool dirIsNeg[3] = {frustum.iMax.x < 0.0f, frustum.iMax.y < 0.0f,
+                            frustum.iMax.z < 0.0f};
+
+  struct Entry {
+    uint32_t node;
+    uint32_t mask; // lanes that hit the parent
+  };
+  Entry stack[stackSize_];
+  int top = 0;
+  Entry current = {0, mask};
+  uint32_t found = 0;
+  ne::stats::Tally<ne::stats::Counter::NodeVisits> visits;
+  ne::stats::Tally<ne::stats::Counter::PrimitiveTests> tests;
+
+  while (true) {
+    const Node &node = nodes_[current.node];
+    visits += ne::stats::lanes(current.mask);
+    float tMax = 0.0f;
+    for (int i = 0; i < ne::RayPacket::width; ++i)
+      tMax = (current.mask & (1u << i)) && packet.t[i] > tMax ? packet.t[i]
+                                                              : tMax;
+    const uint32_t active = frustum.mayHit(node.bounds, tMax)
+                                ? packet.hit(node.bounds, current.mask)
+                                : 0u;
+    if (active) {
+      if (node.count > 0) {
+        tests += ne::stats::lanes(active) * node.count;
+        found |= leaf(node.offset, node.count, packet, active);
+      } else {
+        // all lanes agree on the near child
+        if (dirIsNeg[node.axis]) {
+          stack[top++] = {current.node + 1, active};
+          current = {node.offset, active};
+        } else {
+          stack[top++] = {node.offset, active};
+          current = {current.node + 1, active};
+        }
+        continue;
+      }
+    }
+    if (top == 0)
+      break;
+    current = stack[--top];
+  }
+  return found;
+}
+
+template <typename BoundsFn>
+void BVH::refit(const std::vector<uint32_t> &changed, BoundsFn &&bounds) {
+  if (nodes_.empty() || changed.empty())
+    return;
+  if (parents_.empty())
+    linkParents();
+
+  for (uint32_t position : changed) {
+    uint32_t current = leafOf_[position];
+    const Node &leaf = nodes_[current];
+    ne::AABB box;
+    for (uint32_t i = leaf.offset; i < leaf.offset + leaf.count; ++i)
+      box.expand(bounds(i));
+    // a parent is recomputed after every walk through it, so it ends up
+    // enclosing all of its changed descendants
+    while (setBounds(current, box) && current != 0) {
+      current = parents_[current];
+      box = nodes_[current + 1].bounds;
+      box.expand(nodes_[nodes_[current].offset].bounds);
+    }
+  }
+}
+
+template <typename LeafFn>
+bool BVH::occluded(const ne::Ray &ray, LeafFn &&leaf) const {
+  if (nodes_.empty())
+    return false;
+
+  const glm::vec3 invDir = 1.0f / ray.dir;
+
+  uint32_t stack[stackSize_];
+  int top = 0;
+  uint32_t current = 0;
+  ne::stats::Tally<ne::stats::Counter::NodeVisits> visits;
+  ne::stats::Tally<ne::stats::Counter::PrimitiveTests> tests;
+
+  while (true) {
+    const Node &node = nodes_[current];
+    visits += 1;
+    float tNear;
+    if (node.bounds.hit(ray.o, invDir, ray.t, tNear)) {
+      if (node.count > 0) {
+        tests += node.count;
+        if (leaf(node.offset, node.count, ray))
+          return true;
+      } else {
+        // order does not matter for any hit
+        stack[top++] = node.offset;
+        current = current + 1;
+        continue;
+      }
+    }
+    if (top == 0)
+      break;
+    current = stack[--top];
+  }
+  return false;
+}
+
+} // namespace ne
+
+#endif // __BVH_H_
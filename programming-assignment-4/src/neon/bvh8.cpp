@@ -0,0 +1,225 @@
+#include "neon/bvh8.hpp"
+#include "neon/spherepack.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ne {
+
+namespace {
+
+// smallest power of two exponent, biased, such that 255 steps from lo reach
+// hi in float arithmetic
+uint8_t chooseExponent(float lo, float hi) {
+  int e;
+  std::frexp((hi - lo) / 255.0f, &e);
+  e = std::max(e, -126);
+  while (e < 127 && lo + 255.0f * std::ldexp(1.0f, e) < hi)
+    ++e;
+  return static_cast<uint8_t>(e + 127);
+}
+
+// outward rounded quantization of [lo, hi] against the decoding in
+// BVH8::hitChildren
+void quantize(float origin, float scale, float lo, float hi, uint8_t &qlo,
+              uint8_t &qhi) {
+  int a = static_cast<int>(std::floor((lo - origin) / scale));
+  a = std::min(std::max(a, 0), 255);
+  while (a > 0 && origin + float(a) * scale > lo)
+    --a;
+  int b = static_cast<int>(std::ceil((hi - origin) / scale));
+  b = std::min(std::max(b, 0), 255);
+  while (b < 255 && origin + float(b) * scale < hi)
+    ++b;
+  qlo = static_cast<uint8_t>(a);
+  qhi = static_cast<uint8_t>(b);
+}
+
+} // namespace
+
+void BVH8::clear() { nodes_.clear(); }
+
+bool BVH8::build(ne::BVH &bvh) {
+  clear();
+  if (bvh.empty())
+    return true;
+  avx2_ = static_cast<int>(ne::SpherePack::detect()) >=
+          static_cast<int>(ne::SpherePack::Simd::AVX2);
+
+  // SAH optimal collapse (Ylitie et al. 2017, section 3.1). cost[n][i] is
+  // the cheapest way to turn binary subtree n into at most i + 1 children of
+  // a wide node, split[n][j] the number of those that go to the first child
+  // when n is distributed over j + 1 slots (0 if n is kept as one child).
+  const std::vector<ne::BVH::Node> &binary = bvh.nodes();
+  const size_t n = binary.size();
+  cost_.assign(n, {});
+  split_.assign(n, {});
+  // children are stored after their parent
+  for (size_t i = n; i-- > 0;) {
+    const ne::BVH::Node &node = binary[i];
+    const float area = node.bounds.surfaceArea();
+    if (node.count > 0) {
+      cost_[i].fill(area * node.count);
+      split_[i].fill(0);
+      continue;
+    }
+    const auto &left = cost_[i + 1];
+    const auto &right = cost_[node.offset];
+    // best forest of j + 1 roots from the two children
+    float distribute[8];
+    uint8_t best[8] = {};
+    distribute[0] = std::numeric_limits<float>::max();
+    for (int j = 1; j < 8; ++j) {
+      distribute[j] = std::numeric_limits<float>::max();
+      for (int k = 0; k < j; ++k) {
+        const float c = left[k] + right[j - 1 - k];
+        if (c < distribute[j]) {
+          distribute[j] = c;
+          best[j] = static_cast<uint8_t>(k + 1);
+        }
+      }
+    }
+    // kept as one child, n becomes a wide node of up to eight children
+    cost_[i][0] = area + distribute[7];
+    split_[i][0] = best[7];
+    for (int j = 1; j < 8; ++j) {
+      if (distribute[j] < cost_[i][j - 1]) {
+        cost_[i][j] = distribute[j];
+        split_[i][j] = best[j];
+      } else {
+        cost_[i][j] = cost_[i][j - 1];
+        split_[i][j] = 0;
+      }
+    }
+  }
+
+  nodes_.emplace_back();
+  first_.assign(n, 0);
+  placed_ = 0;
+  const bool ok = bvh.indices().size() <= maxFirst_ && collapse(bvh, 0, 0);
+  if (ok) {
+    boxes_.resize(nodes_.size() * 8);
+    bvh.relocateLeaves(first_);
+    encode(boxes_);
+  }
+  cost_.clear();
+  cost_.shrink_to_fit();
+  split_.clear();
+  split_.shrink_to_fit();
+  first_.clear();
+  first_.shrink_to_fit();
+  boxes_.clear();
+  boxes_.shrink_to_fit();
+  if (!ok) {
+    clear();
+    return false;
+  }
+  nodes_.shrink_to_fit();
+  return true;
+}
+
+void BVH8::gather(const ne::BVH &bvh, uint32_t binaryNode, int slots,
+                  uint32_t *out, int &count) const {
+  const ne::BVH::Node &node = bvh.nodes()[binaryNode];
+  // fewer slots may be just as cheap
+  while (slots > 0 && node.count == 0 && split_[binaryNode][slots] == 0)
+    --slots;
+  if (node.count > 0 || slots == 0) {
+    out[count++] = binaryNode;
+    return;
+  }
+  const int first = split_[binaryNode][slots];
+  gather(bvh, binaryNode + 1, first - 1, out, count);
+  gather(bvh, node.offset, slots - first, out, count);
+}
+
+bool BVH8::collapse(const ne::BVH &bvh, uint32_t binaryNode,
+                    uint32_t nodeIndex) {
+  const std::vector<ne::BVH::Node> &binary = bvh.nodes();
+
+  // a wide root even if the binary root is a leaf
+  uint32_t slots[8];
+  int count = 0;
+  if (binary[binaryNode].count > 0) {
+    slots[count++] = binaryNode;
+  } else {
+    const int first = split_[binaryNode][0];
+    gather(bvh, binaryNode + 1, first - 1, slots, count);
+    gather(bvh, binary[binaryNode].offset, 7 - first, slots, count);
+  }
+
+  // interior children are allocated together, the primitives of the leaf
+  // children are placed one after the other
+  Node node = {};
+  node.count = static_cast<uint32_t>(count);
+  node.childBase = static_cast<uint32_t>(nodes_.size());
+  node.primBase = placed_;
+  boxes_.resize(nodes_.size() * 8);
+  uint32_t numInterior = 0;
+  for (int c = 0; c < count; ++c) {
+    const ne::BVH::Node &child = binary[slots[c]];
+    boxes_[8 * size_t(nodeIndex) + c] = child.bounds;
+    if (child.count == 0) {
+      ++numInterior;
+      continue;
+    }
+    if (child.count > maxLeafSize)
+      return false;
+    node.leafMask |= static_cast<uint8_t>(1u << c);
+    node.leafSizes |= uint32_t(child.count - 1) << (4 * c);
+    first_[slots[c]] = placed_;
+    placed_ += child.count;
+  }
+  if (nodes_.size() + numInterior > maxNodes_)
+    return false;
+  nodes_.resize(nodes_.size() + numInterior);
+  nodes_[nodeIndex] = node;
+
+  uint32_t next = node.childBase;
+  for (int c = 0; c < count; ++c) {
+    if (binary[slots[c]].count == 0 && !collapse(bvh, slots[c], next++))
+      return false;
+  }
+  return true;
+}
+
+void BVH8::encode(const std::vector<ne::AABB> &boxes) {
+  // every node is quantized against the decoded min corner it has in its
+  // parent, which traversal hands down the same way
+  std::vector<glm::vec3> origins(nodes_.size());
+  ne::AABB root;
+  for (int c = 0; c < nodes_[0].count; ++c)
+    root.expand(boxes[c]);
+  rootOrigin_ = origins[0] = root.min;
+
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    Node &node = nodes_[i];
+    const glm::vec3 origin = origins[i];
+    const ne::AABB *child = &boxes[8 * i];
+    ne::AABB box;
+    for (int c = 0; c < node.count; ++c)
+      box.expand(child[c]);
+
+    uint32_t next = node.childBase;
+    glm::vec3 childOrigin[8];
+    for (int a = 0; a < 3; ++a) {
+      node.exponent[a] = chooseExponent(origin[a], box.max[a]);
+      const float scale = exponentScale(node.exponent[a]);
+      for (int c = 0; c < 8; ++c) {
+        // unused slots decode to an inverted box and are masked by count
+        node.lo[a][c] = 255;
+        node.hi[a][c] = 0;
+        if (c >= node.count)
+          continue;
+        quantize(origin[a], scale, child[c].min[a], child[c].max[a],
+                 node.lo[a][c], node.hi[a][c]);
+        childOrigin[c][a] = origin[a] + float(node.lo[a][c]) * scale;
+      }
+    }
+    for (int c = 0; c < node.count; ++c)
+      if (!(node.leafMask & (1u << c)))
+        origins[next++] = childOrigin[c];
+  }
+}
+
+} // namespace ne
@@ -0,0 +1,412 @@
+#ifndef __BVH8_H_
+#define __BVH8_H_
+
+#include "neon/bvh.hpp"
+#include "neon/ray.hpp"
+#include "neon/stats.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) ||            \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NE_BVH8_SIMD 1
+#include <immintrin.h>
+#endif
+
+// GCC and Clang only emit AVX instructions inside functions marked with a
+// target attribute, MSVC accepts the intrinsics anywhere.
+#ifndef NE_TARGET
+#if defined(__GNUC__) || defined(__clang__)
+#define NE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define NE_TARGET(isa)
+#endif
+#endif
+
+namespace ne {
+
+// Eight wide BVH collapsed from a binary ne::BVH. Child bounds are quantized
+// to 8 bits per plane relative to the box of their parent (Ylitie, Karras and
+// Laine 2017), so the boxes of all eight children fit into one 64 byte node
+// and are tested together with AVX2. Interior children of a node are stored
+// next to each other, and building moves the leaves of the binary BVH so that
+// the leaf children of a node cover consecutive primitives. A node then only
+// keeps its first primitive and four bits per leaf size, and the nodes are
+// all the memory the tree needs. Leaves are still the binary BVH's leaves, so
+// the owner's leaf callbacks work unchanged once it applies bvh.indices().
+class BVH8 {
+public:
+  // Child c spans origin + lo[a][c] * scale(a) to origin + hi[a][c] *
+  // scale(a) on axis a, where scale(a) = 2^(exponent[a] - 127). Rounding is
+  // outwards, decoded boxes always contain the exact ones. The origin is not
+  // stored: it is the decoded min corner of the node in its parent, so
+  // traversal carries it down with the node.
+  struct alignas(64) Node {
+    uint32_t childBase : 28; // node index of the first interior child
+    uint32_t count : 4;      // children in slots [0, count)
+    uint32_t primBase;       // first primitive of the leaf children
+    uint8_t exponent[3];     // biased like a float exponent
+    uint8_t leafMask;        // slots that hold leaves
+    uint32_t leafSizes;      // bits 4c to 4c + 3: primitives - 1 of leaf c
+    uint8_t lo[3][8];
+    uint8_t hi[3][8];
+  };
+
+  /// Collapse a binary BVH, choosing the children of every node with the
+  /// surface area heuristic, and relocate its leaves (BVH::relocateLeaves)
+  /// so the leaves of every wide node are neighbours. The owner reorders its
+  /// primitives with bvh.indices() afterwards. Returns false, leaving this
+  /// empty and bvh unchanged, when a leaf has more than maxLeafSize
+  /// primitives or the tree is too large for the node fields.
+  bool build(ne::BVH &bvh);
+
+  /// Quantize again after primitives moved, keeping the topology and the
+  /// primitive order. bounds(p) returns the bounds of the primitive at
+  /// position p.
+  template <typename BoundsFn> void refit(BoundsFn &&bounds);
+
+  void clear();
+  bool empty() const { return nodes_.empty(); }
+
+  const std::vector<Node> &nodes() const { return nodes_; }
+
+  /// bytes used by the nodes
+  size_t memory() const { return nodes_.size() * sizeof(Node); }
+
+  /// Closest hit traversal, same contract as BVH::intersect. Hit children
+  /// are visited in order of their entry distance.
+  template <typename LeafFn> bool intersect(ne::Ray &ray, LeafFn &&leaf) const;
+
+  /// Any hit traversal, same contract as BVH::occluded.
+  template <typename LeafFn>
+  bool occluded(const ne::Ray &ray, LeafFn &&leaf) const;
+
+  inline static constexpr uint32_t maxLeafSize = 16;
+
+private:
+  // traversal reference to a node or a leaf: node index, or leafFlag_ |
+  // (count - 1) << 26 | first primitive
+  inline static constexpr uint32_t leafFlag_ = 0x80000000u;
+  inline static constexpr uint32_t maxFirst_ = 1u << 26;
+  inline static constexpr uint32_t maxNodes_ = 1u << 28;
+
+  static bool isLeaf(uint32_t ref) { return (ref & leafFlag_) != 0; }
+  static uint32_t leafFirst(uint32_t ref) { return ref & (maxFirst_ - 1); }
+  static uint32_t leafCount(uint32_t ref) { return ((ref >> 26) & 31u) + 1; }
+
+  static uint32_t leafSize(const Node &node, int c) {
+    return ((node.leafSizes >> (4 * c)) & 15u) + 1;
+  }
+  static uint32_t childRef(const Node &node, int c) {
+    if (node.leafMask & (1u << c)) {
+      // the leaves of a node follow each other in slot order
+      uint32_t first = node.primBase;
+      for (int k = 0; k < c; ++k)
+        if (node.leafMask & (1u << k))
+          first += leafSize(node, k);
+      return leafFlag_ | (leafSize(node, c) - 1) << 26 | first;
+    }
+    return node.childBase + popcount(~node.leafMask & ((1u << c) - 1u));
+  }
+  static uint32_t popcount(uint32_t v) {
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    return (((v + (v >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+  }
+
+  static float exponentScale(uint8_t exponent) {
+    const uint32_t bits = uint32_t(exponent) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(float));
+    return scale;
+  }
+
+  struct NodeRay {
+    glm::vec3 o;
+    glm::vec3 invDir;
+  };
+
+  // traversal stack entry, origin is unused for leaves
+  struct Entry {
+    uint32_t ref;
+    float tNear;
+    glm::vec3 origin;
+  };
+
+  bool collapse(const ne::BVH &bvh, uint32_t binaryNode, uint32_t nodeIndex);
+  /// append the binary nodes that represent subtree binaryNode in at most
+  /// slots + 1 children
+  void gather(const ne::BVH &bvh, uint32_t binaryNode, int slots,
+              uint32_t *out, int &count) const;
+  /// Quantize every node top down. boxes[8 * n + c] is the exact box of
+  /// child c of node n.
+  void encode(const std::vector<ne::AABB> &boxes);
+
+  /// Test all children of a node whose min corner is origin. Returns the
+  /// mask of children whose box overlaps [0, tFar]. Their entry distances go
+  /// to dist, their decoded min corners to lo.
+  static uint32_t hitChildren(const Node &node, const glm::vec3 &origin,
+                              const NodeRay &r, float tFar, float *dist,
+                              float (*lo)[8]);
+#ifdef NE_BVH8_SIMD
+  NE_TARGET("avx2")
+  static uint32_t hitChildrenAVX2(const Node &node, const glm::vec3 &origin,
+                                  const NodeRay &r, float tFar, float *dist,
+                                  float (*lo)[8]);
+#endif
+
+  template <bool Avx2>
+  uint32_t hitChildren(const Node &node, const glm::vec3 &origin,
+                       const NodeRay &r, float tFar, float *dist,
+                       float (*lo)[8]) const {
+#ifdef NE_BVH8_SIMD
+    if (Avx2)
+      return hitChildrenAVX2(node, origin, r, tFar, dist, lo);
+#endif
+    return hitChildren(node, origin, r, tFar, dist, lo);
+  }
+
+  template <bool Avx2, typename LeafFn>
+  bool intersectImpl(ne::Ray &ray, LeafFn &leaf) const;
+  template <bool Avx2, typename LeafFn>
+  bool occludedImpl(const ne::Ray &ray, LeafFn &leaf) const;
+
+  std::vector<Node> nodes_;
+  glm::vec3 rootOrigin_;
+  bool avx2_ = false;
+  // collapse tables, only alive during build(): SAH costs, new first
+  // primitive of every binary leaf and the exact child boxes
+  std::vector<std::array<float, 8>> cost_;
+  std::vector<std::array<uint8_t, 8>> split_;
+  std::vector<uint32_t> first_;
+  std::vector<ne::AABB> boxes_;
+  uint32_t placed_ = 0;
+
+  // up to seven entries per level of a tree no deeper than the binary one
+  inline static constexpr int stackSize_ = 8 * 64;
+};
+
+inline uint32_t BVH8::hitChildren(const Node &node, const glm::vec3 &origin,
+                                  const NodeRay &r, float tFar, float *dist,
+                                  float (*lo)[8]) {
+  uint32_t result = 0;
+  for (int c = 0; c < node.count; ++c) {
+    float tmin = -std::numeric_limits<float>::max();
+    float tmax = std::numeric_limits<float>::max();
+    for (int a = 0; a < 3; ++a) {
+      const float scale = exponentScale(node.exponent[a]);
+      const float l = origin[a] + float(node.lo[a][c]) * scale;
+      const float h = origin[a] + float(node.hi[a][c]) * scale;
+      lo[a][c] = l;
+      float t0 = (l - r.o[a]) * r.invDir[a];
+      float t1 = (h - r.o[a]) * r.invDir[a];
+      if (t0 > t1)
+        std::swap(t0, t1);
+      // comparisons with NaN are false and keep the previous bound, so a
+      // slab giving NaN does not limit the ray, as in AABB::hit
+      tmin = t0 > tmin ? t0 : tmin;
+      tmax = t1 < tmax ? t1 : tmax;
+    }
+    tmax *= ne::AABB::robustScale_;
+    dist[c] = tmin;
+    if (tmax >= (tmin > 0.0f ? tmin : 0.0f) && tmin <= tFar)
+      result |= 1u << c;
+  }
+  return result;
+}
+
+#ifdef NE_BVH8_SIMD
+
+// Same arithmetic as hitChildren, all eight children at once. Axes where t0
+// or t1 is NaN keep their bounds, like the comparisons above.
+NE_TARGET("avx2")
+inline uint32_t BVH8::hitChildrenAVX2(const Node &node,
+                                      const glm::vec3 &origin,
+                                      const NodeRay &r, float tFar,
+                                      float *dist, float (*lo)[8]) {
+  __m256 tmin = _mm256_set1_ps(-std::numeric_limits<float>::max());
+  __m256 tmax = _mm256_set1_ps(std::numeric_limits<float>::max());
+  for (int a = 0; a < 3; ++a) {
+    const __m256 scale = _mm256_castsi256_ps(
+        _mm256_set1_epi32(static_cast<int>(uint32_t(node.exponent[a]) << 23)));
+    const __m256 o = _mm256_set1_ps(origin[a]);
+    const __m256 qlo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(node.lo[a]))));
+    const __m256 qhi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(node.hi[a]))));
+    // q * scale is exact, so a fused multiply-add rounds the same way
+    const __m256 l = _mm256_add_ps(o, _mm256_mul_ps(qlo, scale));
+    const __m256 h = _mm256_add_ps(o, _mm256_mul_ps(qhi, scale));
+    _mm256_storeu_ps(lo[a], l);
+    const __m256 ro = _mm256_set1_ps(r.o[a]);
+    const __m256 inv = _mm256_set1_ps(r.invDir[a]);
+    const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(l, ro), inv);
+    const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(h, ro), inv);
+    const __m256 ordered = _mm256_cmp_ps(t0, t1, _CMP_ORD_Q);
+    tmin = _mm256_blendv_ps(tmin, _mm256_max_ps(_mm256_min_ps(t0, t1), tmin),
+                            ordered);
+    tmax = _mm256_blendv_ps(tmax, _mm256_min_ps(_mm256_max_ps(t1, t0), tmax),
+                            ordered);
+  }
+  tmax = _mm256_mul_ps(tmax, _mm256_set1_ps(ne::AABB::robustScale_));
+  _mm256_storeu_ps(dist, tmin);
+  const __m256 overlap = _mm256_and_ps(
+      _mm256_cmp_ps(tmax, _mm256_max_ps(tmin, _mm256_setzero_ps()), _CMP_GE_OQ),
+      _mm256_cmp_ps(tmin, _mm256_set1_ps(tFar), _CMP_LE_OQ));
+  return static_cast<uint32_t>(_mm256_movemask_ps(overlap)) &
+         ((1u << node.count) - 1u);
+}
+
+#endif // NE_BVH8_SIMD
+
+template <typename BoundsFn> void BVH8::refit(BoundsFn &&bounds) {
+  if (nodes_.empty())
+    return;
+  // children are stored after their parents, so bottom up is back to front
+  std::vector<ne::AABB> boxes(nodes_.size() * 8);
+  for (size_t i = nodes_.size(); i-- > 0;) {
+    const Node &node = nodes_[i];
+    uint32_t first = node.primBase;
+    uint32_t child = node.childBase;
+    for (int c = 0; c < node.count; ++c) {
+      ne::AABB &box = boxes[8 * i + c];
+      if (node.leafMask & (1u << c)) {
+        const uint32_t end = first + leafSize(node, c);
+        for (; first < end; ++first)
+          box.expand(bounds(first));
+        continue;
+      }
+      for (int k = 0; k < nodes_[child].count; ++k)
+        box.expand(boxes[8 * size_t(child) + k]);
+      ++child;
+    }
+  }
+  encode(boxes);
+}
+
+template <typename LeafFn>
+bool BVH8::intersect(ne::Ray &ray, LeafFn &&leaf) const {
+  if (nodes_.empty())
+    return false;
+#ifdef NE_BVH8_SIMD
+  if (avx2_)
+    return intersectImpl<true>(ray, leaf);
+#endif
+  return intersectImpl<false>(ray, leaf);
+}
+
+template <typename LeafFn>
+bool BVH8::occluded(const ne::Ray &ray, LeafFn &&leaf) const {
+  if (nodes_.empty())
+    return false;
+#ifdef NE_BVH8_SIMD
+  if (avx2_)
+    return occludedImpl<true>(ray, leaf);
+#endif
+  return occludedImpl<false>(ray, leaf);
+}
+
+template <bool Avx2, typename LeafFn>
+bool BVH8::intersectImpl(ne::Ray &ray, LeafFn &leaf) const {
+  const NodeRay r{ray.o, 1.0f / ray.dir};
+
+  Entry stack[stackSize_];
+  int top = 0;
+  Entry current = {0, 0.0f, rootOrigin_};
+  bool found = false;
+  ne::stats::Tally<ne::stats::Counter::NodeVisits> visits;
+  ne::stats::Tally<ne::stats::Counter::PrimitiveTests> tests;
+
+  while (true) {
+    if (isLeaf(current.ref)) {
+      tests += leafCount(current.ref);
+      found =
+          leaf(leafFirst(current.ref), leafCount(current.ref), ray) || found;
+    } else {
+      const Node &node = nodes_[current.ref];
+      visits += 1;
+      alignas(32) float dist[8];
+      alignas(32) float lo[3][8];
+      const uint32_t mask =
+          hitChildren<Avx2>(node, current.origin, r, ray.t, dist, lo);
+
+      if (mask != 0) {
+        // sort hit children far to near, then keep the nearest and push
+        // the others so they pop front to back
+        int order[8];
+        int n = 0;
+        for (int c = 0; c < 8; ++c) {
+          if (!(mask & (1u << c)))
+            continue;
+          int i = n++;
+          for (; i > 0 && dist[order[i - 1]] < dist[c]; --i)
+            order[i] = order[i - 1];
+          order[i] = c;
+        }
+        for (int i = 0; i < n; ++i) {
+          const int c = order[i];
+          const Entry e = {childRef(node, c), dist[c],
+                           glm::vec3(lo[0][c], lo[1][c], lo[2][c])};
+          if (i + 1 < n)
+            stack[top++] = e;
+          else
+            current = e;
+        }
+        continue;
+      }
+    }
+
+    // skip entries that start behind the closest hit found since the push
+    do {
+      if (top == 0)
+        return found;
+      --top;
+    } while (stack[top].tNear > ray.t);
+    current = stack[top];
+  }
+}
+
+template <bool Avx2, typename LeafFn>
+bool BVH8::occludedImpl(const ne::Ray &ray, LeafFn &leaf) const {
+  const NodeRay r{ray.o, 1.0f / ray.dir};
+
+  Entry stack[stackSize_];
+  int top = 0;
+  Entry current = {0, 0.0f, rootOrigin_};
+  ne::stats::Tally<ne::stats::Counter::NodeVisits> visits;
+  ne::stats::Tally<ne::stats::Counter::PrimitiveTests> tests;
+
+  while (true) {
+    if (isLeaf(current.ref)) {
+      tests += leafCount(current.ref);
+      if (leaf(leafFirst(current.ref), leafCount(current.ref), ray))
+        return true;
+    } else {
+      const Node &node = nodes_[current.ref];
+      visits += 1;
+      alignas(32) float dist[8];
+      alignas(32) float lo[3][8];
+      const uint32_t mask =
+          hitChildren<Avx2>(node, current.origin, r, ray.t, dist, lo);
+
+      // order does not matter for any hit
+      for (int c = 0; c < 8; ++c)
+        if (mask & (1u << c))
+          stack[top++] = {childRef(node, c), dist[c],
+                          glm::vec3(lo[0][c], lo[1][c], lo[2][c])};
+    }
+    if (top == 0)
+      return false;
+    current = stack[--top];
+  }
+}
+
+} // namespace ne
+
+#endif // __BVH8_H_
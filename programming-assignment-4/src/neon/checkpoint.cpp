@@ -0,0 +1,200 @@
+#include "neon/checkpoint.hpp"
+#include "neon/trace.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace ne {
+
+namespace {
+
+template <typename T>
+bool readArray(std::ifstream &in, std::vector<T> &v) {
+  in.read(reinterpret_cast<char *>(v.data()), v.size() * sizeof(T));
+  return bool(in);
+}
+
+template <typename T>
+void writeArray(std::ofstream &out, const std::vector<T> &v) {
+  out.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+}
+
+} // namespace
+
+Checkpoint::Checkpoint(const std::string &path, glm::uvec2 size,
+                       const std::vector<ne::TileIterator> &tiles,
+                       uint64_t seed, uint64_t settings)
+    : path_(path), size_(size), tiles_(tiles), seed_(seed),
+      settings_(settings), samples_(tiles.size(), 0),
+      film_(size_t(size.x) * size.y, glm::vec4(0)), state_(film_.size(), 0),
+      inc_(film_.size(), 1) {}
+
+Checkpoint::~Checkpoint() { stop(); }
+
+bool Checkpoint::load() {
+  std::ifstream in(path_, std::ios::binary);
+  if (!in)
+    return false;
+
+  Header header;
+  in.read(reinterpret_cast<char *>(&header), sizeof(Header));
+  if (!in || std::memcmp(header.magic, "NECK", 4) != 0 ||
+      header.version != version_) {
+    std::cout << "Checkpoint " << path_ << " is not a neon checkpoint"
+              << std::endl;
+    return false;
+  }
+  if (header.width != size_.x || header.height != size_.y ||
+      header.numTiles != tiles_.size() || header.seed != seed_) {
+    std::cout << "Checkpoint " << path_ << " belongs to another render"
+              << std::endl;
+    return false;
+  }
+  if (header.settings != settings_) {
+    std::cout << "Checkpoint " << path_
+              << " was rendered with other settings or another scene"
+              << std::endl;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!readArray(in, samples_) || !readArray(in, film_) ||
+      !readArray(in, state_) || !readArray(in, inc_)) {
+    std::cout << "Checkpoint " << path_ << " is truncated" << std::endl;
+    std::fill(samples_.begin(), samples_.end(), 0u);
+    return false;
+  }
+  return true;
+}
+
+uint64_t Checkpoint::hash(const std::string &settings) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (const char c : settings) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+uint32_t Checkpoint::samples(size_t tile) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return samples_[tile];
+}
+
+void Checkpoint::restore(size_t tile, ne::Film &film,
+                         std::vector<ne::Sampler> &samplers) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &index : tiles_[tile]) {
+    const size_t i = index.x + index.y * size_t(size_.x);
+    film(index) = film_[i];
+    samplers[i].state_ = state_[i];
+    samplers[i].inc_ = inc_[i];
+  }
+}
+
+void Checkpoint::store(size_t tile, uint32_t samples, const ne::Film &film,
+                       const std::vector<ne::Sampler> &samplers) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &index : tiles_[tile]) {
+    const size_t i = index.x + index.y * size_t(size_.x);
+    film_[i] = film(index);
+    state_[i] = samplers[i].state_;
+    inc_[i] = samplers[i].inc_;
+  }
+  samples_[tile] = samples;
+  dirty_ = true;
+}
+
+void Checkpoint::start(std::chrono::milliseconds interval) {
+  stop();
+  stop_ = false;
+  writer_ = std::thread(&Checkpoint::run, this, interval);
+}
+
+void Checkpoint::stop() {
+  if (writer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wakeup_.notify_one();
+    writer_.join();
+  }
+}
+
+void Checkpoint::run(std::chrono::milliseconds interval) {
+  if (ne::trace::enabled())
+    ne::trace::setThreadName("checkpoint");
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    wakeup_.wait_for(lock, interval, [this] { return stop_; });
+    if (!dirty_)
+      continue;
+    lock.unlock();
+    write();
+    lock.lock();
+  }
+  if (dirty_) {
+    lock.unlock();
+    write();
+  }
+}
+
+bool Checkpoint::write() {
+  // one write at a time, so an older snapshot never replaces a newer one
+  std::lock_guard<std::mutex> writeLock(writeMutex_);
+  ne::trace::Scope span("checkpoint write", "io");
+
+  Header header;
+  std::memcpy(header.magic, "NECK", 4);
+  header.version = version_;
+  header.width = size_.x;
+  header.height = size_.y;
+  header.numTiles = static_cast<uint32_t>(tiles_.size());
+  header.reserved = 0;
+  header.seed = seed_;
+  header.settings = settings_;
+
+  // snapshot, the render threads only wait for this copy
+  std::vector<uint32_t> samples;
+  std::vector<glm::vec4> film;
+  std::vector<uint64_t> state, inc;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples = samples_;
+    film = film_;
+    state = state_;
+    inc = inc_;
+    dirty_ = false;
+  }
+
+  const std::string tmp = path_ + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    writeArray(out, samples);
+    writeArray(out, film);
+    writeArray(out, state);
+    writeArray(out, inc);
+    // close flushes, a full disk may only show up here
+    out.close();
+    if (!out) {
+      std::cout << "Checkpoint write to " << tmp << " failed" << std::endl;
+      return false;
+    }
+  }
+
+#ifdef _WIN32
+  // rename does not replace an existing file on Windows
+  std::remove(path_.c_str());
+#endif
+  if (std::rename(tmp.c_str(), path_.c_str()) != 0) {
+    std::cout << "Checkpoint rename to " << path_ << " failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace ne
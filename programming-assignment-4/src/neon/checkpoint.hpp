@@ -0,0 +1,117 @@
+#ifndef __CHECKPOINT_H_
+#define __CHECKPOINT_H_
+
+#include "neon/film.hpp"
+#include "neon/image.hpp"
+#include "neon/sampler.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ne {
+
+// Render state that survives a killed process. For every tile it keeps the
+// number of samples already accumulated, and for every pixel the film sum,
+// the sample count and the sampler state, so a resumed render continues the
+// exact random streams and ends up with the same image as an uninterrupted
+// one.
+//
+// Render threads only copy a finished tile into a staging buffer (store). A
+// writer thread snapshots that buffer every `interval` and writes it to disk,
+// so file I/O never runs on a render thread. Files are written next to the
+// target and renamed over it, a crash during a write keeps the old one.
+//
+// The header also keeps a hash of everything else that shapes the image
+// (scene, sample counts, integrator), see hash(). A checkpoint of another
+// render is refused instead of being mixed into this one.
+//
+// File layout (native endianness):
+//   Header, uint32_t samples[numTiles], glm::vec4 film[numPixels],
+//   uint64_t state[numPixels], uint64_t inc[numPixels]
+// Pixels are stored row by row, x + y * width.
+class Checkpoint {
+public:
+  Checkpoint(const std::string &path, glm::uvec2 size,
+             const std::vector<ne::TileIterator> &tiles, uint64_t seed,
+             uint64_t settings);
+  ~Checkpoint();
+
+  Checkpoint(const Checkpoint &) = delete;
+  Checkpoint &operator=(const Checkpoint &) = delete;
+
+  /// Read the file at path. Fails if it is missing, truncated or was written
+  /// for another image size, tiling, seed or settings hash.
+  bool load();
+
+  /// 64 bit FNV-1a of a description of the render settings, e.g. scene id,
+  /// obj path, spp and integrator joined into one string
+  static uint64_t hash(const std::string &settings);
+
+  /// samples accumulated in the tile so far
+  uint32_t samples(size_t tile) const;
+
+  /// copy the saved state of a tile into film and samplers
+  void restore(size_t tile, ne::Film &film,
+               std::vector<ne::Sampler> &samplers) const;
+
+  /// Record that a tile holds `samples` samples. Called by the render thread
+  /// that just finished the tile, copies only the tile's pixels.
+  void store(size_t tile, uint32_t samples, const ne::Film &film,
+             const std::vector<ne::Sampler> &samplers);
+
+  /// start writing in the background, at most once per interval
+  void start(std::chrono::milliseconds interval);
+
+  /// stop the writer and write pending changes
+  void stop();
+
+  /// write the current state now, on the calling thread
+  bool write();
+
+  const std::string &path() const { return path_; }
+
+private:
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t numTiles;
+    uint32_t reserved;
+    uint64_t seed;
+    uint64_t settings;
+  };
+
+  static constexpr uint32_t version_ = 2;
+
+  void run(std::chrono::milliseconds interval);
+
+  std::string path_;
+  glm::uvec2 size_;
+  std::vector<ne::TileIterator> tiles_;
+  uint64_t seed_;
+  uint64_t settings_;
+
+  // staging buffer, guarded by mutex_
+  mutable std::mutex mutex_;
+  std::vector<uint32_t> samples_;
+  std::vector<glm::vec4> film_;
+  std::vector<uint64_t> state_;
+  std::vector<uint64_t> inc_;
+  bool dirty_ = false;
+
+  std::mutex writeMutex_;
+  std::thread writer_;
+  std::condition_variable wakeup_;
+  bool stop_ = false;
+};
+
+} // namespace ne
+
+#endif // __CHECKPOINT_H_
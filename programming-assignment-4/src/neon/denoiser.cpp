@@ -0,0 +1,180 @@
+#include "neon/denoiser.hpp"
+#include "neon/trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <taskflow/taskflow.hpp>
+
+// -O2 leaves the row loops scalar on older GCC
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("tree-vectorize")
+#endif
+
+// the row filter is also compiled for AVX2 and picked at load time
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) &&         \
+    defined(__linux__)
+#define NE_TARGET_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define NE_TARGET_CLONES
+#endif
+
+namespace ne {
+
+namespace {
+
+// 1D B3 spline, the 5 x 5 kernel is its outer product
+constexpr float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4,
+                             1.0f / 16};
+
+// rows per task
+constexpr unsigned int bandHeight = 16;
+
+// Weights of the taps (dy, dx) of row y for every x in [x0, x1), neighbour q
+// is the pixel off floats further. (1 - d / 4)^4 stands in for exp(-d): it
+// is almost as smooth and vectorizes without a call. The sums never alias the
+// planes, without __restrict the compiler gives up on checking 13 pointers.
+NE_TARGET_CLONES
+void accumulateTap(const float *cr, const float *cg, const float *cb,
+                   const float *ar, const float *ag, const float *ab,
+                   const float *nr, const float *ng, const float *nb,
+                   int off, int x0, int x1, float k, float invColor,
+                   float invNormal, float invAlbedo, float *__restrict sr,
+                   float *__restrict sg, float *__restrict sb,
+                   float *__restrict sw) {
+  for (int x = x0; x < x1; ++x) {
+    const int q = x + off;
+    const float dcr = cr[x] - cr[q], dcg = cg[x] - cg[q], dcb = cb[x] - cb[q];
+    const float dar = ar[x] - ar[q], dag = ag[x] - ag[q], dab = ab[x] - ab[q];
+    const float dnr = nr[x] - nr[q], dng = ng[x] - ng[q], dnb = nb[x] - nb[q];
+    const float d = (dcr * dcr + dcg * dcg + dcb * dcb) * invColor +
+                    (dar * dar + dag * dag + dab * dab) * invAlbedo +
+                    (dnr * dnr + dng * dng + dnb * dnb) * invNormal;
+    // max(t, 0) without a compare, which would keep the loop scalar
+    const float t = 1.0f - 0.25f * d;
+    float w = 0.5f * (t + std::fabs(t));
+    w *= w;
+    w *= k * w;
+    sr[x] += w * cr[q];
+    sg[x] += w * cg[q];
+    sb[x] += w * cb[q];
+    sw[x] += w;
+  }
+}
+
+} // namespace
+
+void Denoiser::denoise(const ne::Film &color, const ne::Film &albedo,
+                       const ne::Film &normal, ne::Film &output,
+                       unsigned int numThreads) {
+  ne::trace::Scope span("denoise", "post");
+  width_ = color.width();
+  height_ = color.height();
+  const size_t n = size_t(width_) * height_;
+  color_.resize(n);
+  next_.resize(n);
+  albedo_.resize(n);
+  normal_.resize(n);
+
+  // demodulate, surfaces without albedo (black or emitting) keep their color
+  auto divisor = [](float a) { return a > 0.01f ? a : 1.0f; };
+  for (unsigned int y = 0; y < height_; ++y) {
+    for (unsigned int x = 0; x < width_; ++x) {
+      const glm::uvec2 index(x, y);
+      const size_t i = x + size_t(y) * width_;
+      const glm::vec3 a = albedo.mean(index);
+      const glm::vec3 nrm = normal.mean(index);
+      const glm::vec3 c = color.mean(index);
+      albedo_.r[i] = a.x;
+      albedo_.g[i] = a.y;
+      albedo_.b[i] = a.z;
+      normal_.r[i] = nrm.x;
+      normal_.g[i] = nrm.y;
+      normal_.b[i] = nrm.z;
+      color_.r[i] = c.x / divisor(a.x);
+      color_.g[i] = c.y / divisor(a.y);
+      color_.b[i] = c.z / divisor(a.z);
+    }
+  }
+
+  // one stage per pass, every stage waits for all bands of the last one
+  tf::Taskflow taskflow(std::max(numThreads, 1u));
+  tf::Task previous = taskflow.emplace([]() {});
+  float sigmaColor = settings_.sigmaColor;
+  for (int i = 0; i < settings_.iterations; ++i) {
+    tf::Task done = taskflow.emplace([this]() { std::swap(color_, next_); });
+    for (unsigned int y = 0; y < height_; y += bandHeight) {
+      const unsigned int end = std::min(height_, y + bandHeight);
+      tf::Task band = taskflow.emplace([this, i, sigmaColor, y, end]() {
+        filterRows(1 << i, sigmaColor, y, end);
+      });
+      previous.precede(band);
+      band.precede(done);
+    }
+    previous = done;
+    sigmaColor *= 0.5f;
+  }
+  taskflow.wait_for_all();
+
+  if (output.size() != color.size())
+    output = ne::Film(color.size());
+  for (unsigned int y = 0; y < height_; ++y) {
+    for (unsigned int x = 0; x < width_; ++x) {
+      const size_t i = x + size_t(y) * width_;
+      const glm::vec3 c(color_.r[i] * divisor(albedo_.r[i]),
+                        color_.g[i] * divisor(albedo_.g[i]),
+                        color_.b[i] * divisor(albedo_.b[i]));
+      output(glm::uvec2(x, y)) = glm::vec4(c, 1.0f);
+    }
+  }
+}
+
+void Denoiser::filterRows(int step, float sigmaColor, unsigned int y0,
+                          unsigned int y1) {
+  const int width = static_cast<int>(width_);
+  const int height = static_cast<int>(height_);
+  const float invColor = 1.0f / (sigmaColor * sigmaColor);
+  const float invNormal =
+      1.0f / (settings_.sigmaNormal * settings_.sigmaNormal);
+  const float invAlbedo =
+      1.0f / (settings_.sigmaAlbedo * settings_.sigmaAlbedo);
+
+  std::vector<float> sr(width), sg(width), sb(width), sw(width);
+  for (int y = static_cast<int>(y0); y < static_cast<int>(y1); ++y) {
+    std::fill(sr.begin(), sr.end(), 0.0f);
+    std::fill(sg.begin(), sg.end(), 0.0f);
+    std::fill(sb.begin(), sb.end(), 0.0f);
+    std::fill(sw.begin(), sw.end(), 0.0f);
+
+    const size_t row = size_t(y) * width;
+    for (int dy = -2; dy <= 2; ++dy) {
+      const int yq = y + dy * step;
+      // taps outside the image are dropped, the weights renormalize
+      if (yq < 0 || yq >= height)
+        continue;
+      // pointers are shifted so that the neighbour of x in row yq is x + off
+      const ptrdiff_t shift = ptrdiff_t(yq - y) * width;
+      for (int dx = -2; dx <= 2; ++dx) {
+        const int off = dx * step;
+        const int x0 = std::max(0, -off);
+        const int x1 = std::min(width, width - off);
+        if (x0 >= x1)
+          continue;
+        const float k = kernel[dy + 2] * kernel[dx + 2];
+        accumulateTap(&color_.r[row], &color_.g[row], &color_.b[row],
+                      &albedo_.r[row], &albedo_.g[row], &albedo_.b[row],
+                      &normal_.r[row], &normal_.g[row], &normal_.b[row],
+                      int(shift) + off, x0, x1, k, invColor, invNormal,
+                      invAlbedo, sr.data(), sg.data(), sb.data(), sw.data());
+      }
+    }
+
+    for (int x = 0; x < width; ++x) {
+      // the center tap always has weight, sw > 0
+      next_.r[row + x] = sr[x] / sw[x];
+      next_.g[row + x] = sg[x] / sw[x];
+      next_.b[row + x] = sb[x] / sw[x];
+    }
+  }
+}
+
+} // namespace ne
@@ -0,0 +1,62 @@
+#ifndef __DENOISER_H_
+#define __DENOISER_H_
+
+#include "neon/film.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ne {
+
+struct DenoiserSettings {
+  // filter passes, pass i spaces its 5 x 5 taps 2^i pixels apart. More
+  // passes blur shading gradients on the low noise images neon renders.
+  int iterations = 2;
+  // edge stopping, a neighbour with this difference gets about 1/e of the
+  // weight. The color sigma is halved after every pass.
+  float sigmaColor = 0.4f;
+  float sigmaNormal = 0.3f;
+  float sigmaAlbedo = 0.1f;
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) guided by the
+// first hit albedo and normal of the render. Color is divided by albedo
+// before filtering and multiplied back afterwards, so the filter only blurs
+// lighting and keeps material edges sharp.
+//
+// The image is kept as one float plane per channel and filtered row by row
+// in contiguous loops the compiler vectorizes. Every pass is split into
+// bands of rows that run in parallel.
+class Denoiser {
+public:
+  explicit Denoiser(const DenoiserSettings &settings = DenoiserSettings())
+      : settings_(settings) {}
+
+  /// Filter the mean of color, guided by the means of albedo and normal
+  /// (Films of the same size). output receives one sample per pixel.
+  void denoise(const ne::Film &color, const ne::Film &albedo,
+               const ne::Film &normal, ne::Film &output,
+               unsigned int numThreads = 1);
+
+private:
+  // channels of the image, each one plane of width * height floats
+  struct Planes {
+    std::vector<float> r, g, b;
+    void resize(size_t n) {
+      r.resize(n);
+      g.resize(n);
+      b.resize(n);
+    }
+  };
+
+  void filterRows(int step, float sigmaColor, unsigned int y0,
+                  unsigned int y1);
+
+  DenoiserSettings settings_;
+  unsigned int width_ = 0, height_ = 0;
+  Planes color_, next_, albedo_, normal_;
+};
+
+} // namespace ne
+
+#endif // __DENOISER_H_
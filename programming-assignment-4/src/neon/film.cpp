@@ -0,0 +1,30 @@
+#include "neon/film.hpp"
+
+#include <algorithm>
+
+namespace ne {
+
+Film::Film(const glm::uvec2 size)
+    : size_(size), pixels_(size_t(size.x) * size.y, glm::vec4(0.0f)) {}
+
+void Film::clear() {
+  std::fill(pixels_.begin(), pixels_.end(), glm::vec4(0.0f));
+}
+
+void Film::tonemap(ne::Image &image, Tonemap op, float exposure) const {
+  if (image.size() != size_)
+    image.resize(size_.x, size_.y);
+
+  for (unsigned int j = 0; j < size_.y; ++j) {
+    for (unsigned int i = 0; i < size_.x; ++i) {
+      const glm::uvec2 index(i, j);
+      glm::vec3 color = exposure * mean(index);
+      if (op == Tonemap::Reinhard)
+        color = color / (1.0f + color);
+      color = glm::clamp(color, 0.0f, 1.0f);
+      image(index) = glm::u8vec4(color * 255.99f, 255.0f);
+    }
+  }
+}
+
+} // namespace ne
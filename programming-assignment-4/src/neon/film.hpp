@@ -0,0 +1,80 @@
+#ifndef __FILM_H_
+#define __FILM_H_
+
+#include "neon/image.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ne {
+
+// HDR accumulation buffer. Every pixel keeps the float sum of its radiance
+// samples and their count, so a render can be extended by more passes at any
+// time and developed into an 8 bit ne::Image whenever a preview is needed.
+// Uses the same pixel addressing as ne::Image, tiles write disjoint pixels.
+class Film {
+public:
+  enum class Tonemap { Clamp, Reinhard };
+
+  Film(const glm::uvec2 size = glm::uvec2(0));
+
+  glm::uvec2 size() const { return size_; }
+  unsigned int width() const { return size_.x; }
+  unsigned int height() const { return size_.y; }
+  unsigned int numPixels() const { return size_.x * size_.y; }
+
+  /// add one sample
+  inline void add(const glm::uvec2 index, const glm::vec3 &sample) {
+    glm::vec4 &p = pixels_[offset(index)];
+    p += glm::vec4(sample, 1.0f);
+  }
+
+  /// add a sum of count samples
+  inline void add(const glm::uvec2 index, const glm::vec3 &sum,
+                  uint32_t count) {
+    glm::vec4 &p = pixels_[offset(index)];
+    p += glm::vec4(sum, float(count));
+  }
+
+  inline glm::vec3 mean(const glm::uvec2 index) const {
+    const glm::vec4 &p = pixels_[offset(index)];
+    return p.w > 0.0f ? glm::vec3(p) / p.w : glm::vec3(0.0f);
+  }
+
+  inline uint32_t count(const glm::uvec2 index) const {
+    return static_cast<uint32_t>(pixels_[offset(index)].w);
+  }
+
+  /// raw pixel, rgb = sample sum, w = sample count
+  inline glm::vec4 &operator()(const glm::uvec2 index) {
+    return pixels_[offset(index)];
+  }
+  inline const glm::vec4 &operator()(const glm::uvec2 index) const {
+    return pixels_[offset(index)];
+  }
+
+  void clear();
+
+  /// Develop the current estimate into an 8 bit image of the same size.
+  /// Clamp matches the original sandbox output, Reinhard compresses
+  /// highlights instead of clipping them.
+  void tonemap(ne::Image &image, Tonemap op = Tonemap::Clamp,
+               float exposure = 1.0f) const;
+
+  /// raw pixels, rgb = sample sum, w = sample count
+  std::vector<glm::vec4> &data() { return pixels_; }
+  const std::vector<glm::vec4> &data() const { return pixels_; }
+
+private:
+  inline size_t offset(const glm::uvec2 index) const {
+    return index.x + (size_.y - index.y - 1) * size_t(size_.x);
+  }
+
+  glm::uvec2 size_;
+  std::vector<glm::vec4> pixels_;
+};
+
+} // namespace ne
+
+#endif // __FILM_H_
@@ -0,0 +1,62 @@
+#include "neon/group.hpp"
+
+namespace ne {
+
+void Group::add(RendablePointer object) {
+  bounds_.expand(object->bounds());
+  objects_.push_back(std::move(object));
+  bvh_.clear();
+}
+
+void Group::build() {
+  std::vector<ne::AABB> bounds;
+  bounds.reserve(objects_.size());
+  for (const auto &o : objects_)
+    bounds.push_back(o->bounds());
+  bvh_.build(bounds);
+
+  // reorder objects so that every leaf refers to a contiguous range
+  std::vector<RendablePointer> ordered;
+  ordered.reserve(objects_.size());
+  for (uint32_t i : bvh_.indices())
+    ordered.push_back(objects_[i]);
+  objects_.swap(ordered);
+}
+
+bool Group::rayIntersect(ne::Ray &ray, ne::Intersection &hit) {
+  if (bvh_.empty()) {
+    bool found = false;
+    for (const auto &o : objects_)
+      found = o->rayIntersect(ray, hit) || found;
+    return found;
+  }
+  return bvh_.intersect(ray, [&](uint32_t first, uint32_t count, ne::Ray &r) {
+    bool found = false;
+    for (uint32_t i = first; i < first + count; ++i)
+      found = objects_[i]->rayIntersect(r, hit) || found;
+    return found;
+  });
+}
+
+bool Group::occluded(const ne::Ray &ray) {
+  if (bvh_.empty()) {
+    for (const auto &o : objects_)
+      if (o->occluded(ray))
+        return true;
+    return false;
+  }
+  return bvh_.occluded(ray,
+                       [&](uint32_t first, uint32_t count, const ne::Ray &r) {
+                         for (uint32_t i = first; i < first + count; ++i)
+                           if (objects_[i]->occluded(r))
+                             return true;
+                         return false;
+                       });
+}
+
+void Group::collectMaterials(std::vector<MaterialPointer> &out) const {
+  for (const auto &o : objects_)
+    o->collectMaterials(out);
+}
+
+} // namespace ne
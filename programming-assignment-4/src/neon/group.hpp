@@ -0,0 +1,40 @@
+#ifndef __GROUP_H_
+#define __GROUP_H_
+
+#include "neon/blueprint.hpp"
+#include "neon/bvh.hpp"
+#include "neon/rendable.hpp"
+
+#include <vector>
+
+namespace ne {
+
+// Bottom level structure: a set of rendables with its own BVH, in object
+// space. Share one Group between many ne::Instance objects to place the same
+// cluster of primitives several times without copying it. Hits report the
+// material of the child that was hit.
+class Group : public abstract::Rendable {
+public:
+  Group() = default;
+
+  void add(RendablePointer object);
+  /// Build the BVH. Must be called after the last add(), before rendering.
+  void build();
+
+  bool rayIntersect(ne::Ray &ray, ne::Intersection &hit) override;
+  bool occluded(const ne::Ray &ray) override;
+  ne::AABB bounds() const override { return bounds_; }
+  void collectMaterials(std::vector<MaterialPointer> &out) const override;
+
+  const std::vector<RendablePointer> &objects() const { return objects_; }
+
+private:
+  // in BVH leaf order after build()
+  std::vector<RendablePointer> objects_;
+  ne::AABB bounds_;
+  ne::BVH bvh_;
+};
+
+} // namespace ne
+
+#endif // __GROUP_H_
@@ -1,4 +1,5 @@
 #include "image.hpp"
+#include "neon/trace.hpp"
 #include <cstring>
 #include <iostream>
 #include <lodepng/lodepng.h>
@@ -11,6 +12,7 @@ void Image::resize(int width, int height) {
 }
 
 void Image::save(const char *filename) const {
+  ne::trace::Scope span("png encode", "io");
   unsigned int byteSize = this->totalBytes();
   std::vector<unsigned char> data(byteSize);
   std::memcpy((void *)data.data(), pixels_.data(), byteSize);
@@ -37,6 +37,13 @@ public:
 
   const glm::uvec2 &operator*() const { return current_; }
 
+  // pixel bounds [startIndex, endIndex)
+  const glm::uvec2 &startIndex() const { return start_; }
+  const glm::uvec2 &endIndex() const { return end_; }
+  unsigned int numPixels() const {
+    return (end_.x - start_.x) * (end_.y - start_.y);
+  }
+
   inline void increment() {
     if (++current_.x == end_.x && ++current_.y != end_.y)
       current_.x = start_.x;
@@ -0,0 +1,64 @@
+#include "neon/instance.hpp"
+
+namespace ne {
+
+Instance::Instance(RendablePointer object, const glm::mat4 &toWorld,
+                   MaterialPointer m)
+    : ne::abstract::Rendable(m), object_(std::move(object)) {
+  setTransform(toWorld);
+}
+
+void Instance::setTransform(const glm::mat4 &toWorld) {
+  toWorld_ = toWorld;
+  toObject_ = glm::inverse(toWorld);
+  normalToWorld_ = glm::transpose(glm::mat3(toObject_));
+
+  // world bounds enclose the transformed corners of the object bounds
+  bounds_ = ne::AABB();
+  const ne::AABB box = object_->bounds();
+  for (int i = 0; i < 8; ++i) {
+    const glm::vec3 corner((i & 1) ? box.max.x : box.min.x,
+                           (i & 2) ? box.max.y : box.min.y,
+                           (i & 4) ? box.max.z : box.min.z);
+    bounds_.expand(glm::vec3(toWorld_ * glm::vec4(corner, 1.0f)));
+  }
+}
+
+ne::Ray Instance::toObject(const ne::Ray &ray, float &scale) const {
+  ne::Ray local;
+  local.o = glm::vec3(toObject_ * glm::vec4(ray.o, 1.0f));
+  const glm::vec3 dir = glm::mat3(toObject_) * ray.dir;
+  // object space units per world space unit along the ray
+  scale = glm::length(dir);
+  local.dir = dir / scale;
+  local.t = ray.t * scale;
+  return local;
+}
+
+bool Instance::rayIntersect(ne::Ray &ray, ne::Intersection &hit) {
+  float scale;
+  ne::Ray local = toObject(ray, scale);
+  if (!object_->rayIntersect(local, hit))
+    return false;
+
+  ray.t = local.t / scale;
+  hit.p = ray.at(ray.t);
+  hit.n = glm::normalize(normalToWorld_ * hit.n);
+  if (material_)
+    hit.material = material_.get();
+  return true;
+}
+
+bool Instance::occluded(const ne::Ray &ray) {
+  float scale;
+  return object_->occluded(toObject(ray, scale));
+}
+
+void Instance::collectMaterials(std::vector<MaterialPointer> &out) const {
+  if (material_)
+    out.push_back(material_);
+  else
+    object_->collectMaterials(out);
+}
+
+} // namespace ne
@@ -0,0 +1,49 @@
+#ifndef __INSTANCE_H_
+#define __INSTANCE_H_
+
+#include "neon/blueprint.hpp"
+#include "neon/rendable.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ne {
+
+// A placement of shared geometry (ne::Group, ne::TriangleMesh or any other
+// rendable) with an affine transform. The instance only stores the
+// transforms and world bounds, so memory grows with the unique geometry, not
+// with the number of instances. The scene BVH acts as the top level over the
+// instances; rays are moved into object space here and traverse the shared
+// bottom level structure.
+class Instance : public abstract::Rendable {
+public:
+  /// m overrides the material of every hit when set
+  Instance(RendablePointer object, const glm::mat4 &toWorld,
+           MaterialPointer m = nullptr);
+
+  bool rayIntersect(ne::Ray &ray, ne::Intersection &hit) override;
+  bool occluded(const ne::Ray &ray) override;
+  ne::AABB bounds() const override { return bounds_; }
+  void collectMaterials(std::vector<MaterialPointer> &out) const override;
+
+  const RendablePointer &object() const { return object_; }
+  const glm::mat4 &toWorld() const { return toWorld_; }
+  /// Move the instance. A built scene only sees the change through
+  /// Scene::setTransform or Scene::update.
+  void setTransform(const glm::mat4 &toWorld);
+
+private:
+  /// object space ray; its direction is renormalized, scale maps object
+  /// space distances back to world space
+  ne::Ray toObject(const ne::Ray &ray, float &scale) const;
+
+  RendablePointer object_;
+  glm::mat4 toWorld_;
+  glm::mat4 toObject_;
+  glm::mat3 normalToWorld_;
+  ne::AABB bounds_;
+};
+
+} // namespace ne
+
+#endif // __INSTANCE_H_
@@ -1,14 +1,77 @@
 #include "integrator.hpp"
 #include "neon/intersection.hpp"
 #include "neon/material.hpp"
+#include "neon/raypacket.hpp"
+#include "neon/sampler.hpp"
 #include "neon/scene.hpp"
+#include "neon/stats.hpp"
 
 namespace ne {
 
     namespace core {
 
+        bool russianRoulette(const IntegratorSettings& settings, int bounces,
+            glm::vec3& throughput, ne::Sampler& sampler) {
+            if (!settings.russianRoulette || bounces < settings.minDepth)
+                return true;
+
+            const float survival = glm::min(
+                glm::max(throughput.x, glm::max(throughput.y, throughput.z)), 0.95f);
+            if (sampler.next1D() >= survival) {
+                ne::stats::add(ne::stats::Counter::RouletteTerminations);
+                return false;
+            }
+
+            throughput /= survival;
+            return true;
+        }
+
+        FirstHit FirstHit::make(bool found, const ne::Ray& ray,
+            const ne::Intersection& hit) {
+            FirstHit first;
+            if (found) {
+                first.albedo = ne::attenuation(*hit.material) +
+                    glm::min(ne::emitted(*hit.material), glm::vec3(1.0f));
+                first.normal = hit.n;
+                first.depth = ray.t;
+                first.hits = 1.0f;
+                first.material = hit.material;
+            }
+            return first;
+        }
+
         glm::vec3 Integrator::integrate(const ne::Ray& ray,
-            std::shared_ptr<ne::Scene> scene) {
+            const std::shared_ptr<ne::Scene>& scene, ne::Sampler& sampler,
+            FirstHit* firstHit) {
+            ne::Ray cameraRay = ray;
+            ne::Intersection hit;
+            ne::stats::add(ne::stats::Counter::CameraRays);
+            const bool found = scene->rayIntersect(cameraRay, hit);
+            if (firstHit)
+                *firstHit = FirstHit::make(found, cameraRay, hit);
+            return continuePath(cameraRay, found, hit, scene, sampler);
+        }
+
+        void Integrator::integrate(ne::RayPacket& packet,
+            const std::shared_ptr<ne::Scene>& scene,
+            ne::Sampler* const* samplers, glm::vec3* radiance,
+            FirstHit* firstHits) {
+            ne::Intersection hits[ne::RayPacket::width];
+            ne::stats::add(ne::stats::Counter::CameraRays, ne::stats::lanes(packet.valid));
+            const uint32_t found = scene->rayIntersect(packet, hits);
+            for (int i = 0; i < ne::RayPacket::width; ++i) {
+                if (packet.valid & (1u << i)) {
+                    if (firstHits)
+                        firstHits[i] = FirstHit::make((found >> i) & 1u, packet.rays[i], hits[i]);
+                    radiance[i] = continuePath(packet.rays[i], (found >> i) & 1u,
+                        hits[i], scene, *samplers[i]);
+                }
+            }
+        }
+
+        glm::vec3 Integrator::continuePath(const ne::Ray& ray, bool found,
+            const ne::Intersection& hit,
+            const std::shared_ptr<ne::Scene>& scene, ne::Sampler& sampler) {
 
             glm::vec3 accumulatedLight{ 0.0f };
             glm::vec3 colorAttenuation = glm::vec3(1.0f);
@@ -17,26 +80,41 @@ namespace ne {
             int bounceCount = 0;
             bool intersected = true;
 
-            while (bounceCount < 10 && intersected) {
-                ne::Intersection intersection;
-                intersected = scene->rayIntersect(activeRay, intersection);
+            while (bounceCount < settings_.maxDepth && intersected) {
+                ne::Intersection intersection = hit;
+                intersected = found;
+                if (bounceCount > 0) {
+                    intersection = ne::Intersection();
+                    ne::stats::add(ne::stats::Counter::BounceRays);
+                    intersected = scene->rayIntersect(activeRay, intersection);
+                }
 
                 if (intersected) {
-                    MaterialPointer surfaceMaterial = intersection.material;
+                    const ne::abstract::Material* surfaceMaterial = intersection.material;
                     ne::Ray reflectedRay;
 
-                    if (surfaceMaterial->scatter(activeRay, intersection, reflectedRay)) {
-                        glm::vec3 sampledDirectLight = scene->sampleDirectLight(reflectedRay, intersection);
+                    if (ne::scatter(*surfaceMaterial, activeRay, intersection, reflectedRay, sampler)) {
+                        glm::vec3 sampledDirectLight = scene->sampleDirectLight(reflectedRay, intersection, sampler);
 
                         accumulatedLight = accumulatedLight + (colorAttenuation * sampledDirectLight);
 
-                        colorAttenuation = colorAttenuation * surfaceMaterial->attenuation();
+                        colorAttenuation = colorAttenuation * ne::attenuation(*surfaceMaterial);
 
                         activeRay = reflectedRay;
+
+                        // stop paths that can barely contribute anymore
+                        if (!russianRoulette(settings_, bounceCount + 1, colorAttenuation, sampler)) {
+                            ++statistics_.rouletteTerminated;
+                            ++bounceCount;
+                            break;
+                        }
+                        if (bounceCount + 1 >= settings_.maxDepth)
+                            ne::stats::add(ne::stats::Counter::DepthTerminations);
                     }
 
                     else {
-                        accumulatedLight += colorAttenuation * surfaceMaterial->emitted();
+                        accumulatedLight += colorAttenuation * ne::emitted(*surfaceMaterial);
+                        ++bounceCount;
                         break;
                     }
                 }
@@ -46,6 +124,8 @@ namespace ne {
                 ++bounceCount;
             }
 
+            // every iteration traced exactly one ray
+            statistics_.record(bounceCount);
             return accumulatedLight;
         }
 
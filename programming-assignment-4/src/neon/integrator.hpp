@@ -3,18 +3,109 @@
 
 #include "neon/blueprint.hpp"
 
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <memory>
+#include <vector>
 
 namespace ne {
 
     namespace core {
 
+        // Path termination. After minDepth bounces a path survives Russian
+        // roulette with probability max(throughput) (at most 0.95) and is
+        // reweighted by 1 / probability, which keeps the estimate unbiased.
+        struct IntegratorSettings {
+            int maxDepth = 10;          // hard limit of rays per path
+            int minDepth = 3;           // bounces before roulette may kill a path
+            bool russianRoulette = true;
+        };
+
+        // How long the traced paths were. lengths[n] counts the paths that
+        // traced n rays (camera ray included).
+        struct PathStatistics {
+            std::vector<uint64_t> lengths;
+            uint64_t rouletteTerminated = 0;
+
+            void record(int length) {
+                if (lengths.size() <= static_cast<size_t>(length))
+                    lengths.resize(length + 1, 0);
+                ++lengths[length];
+            }
+
+            void merge(const PathStatistics& other) {
+                if (lengths.size() < other.lengths.size())
+                    lengths.resize(other.lengths.size(), 0);
+                for (size_t i = 0; i < other.lengths.size(); ++i)
+                    lengths[i] += other.lengths[i];
+                rouletteTerminated += other.rouletteTerminated;
+            }
+        };
+
+        // First surface seen by a camera ray, feeds ne::AovBuffer and the
+        // guides of ne::Denoiser. Albedo is the attenuation of the material,
+        // or the emission of a light clamped to 1. Escaped rays get albedo 1,
+        // normal 0 and no depth. Summing several makes hits count the rays
+        // that hit something, depth / hits is their mean distance.
+        struct FirstHit {
+            glm::vec3 albedo{ 1.0f };
+            glm::vec3 normal{ 0.0f };
+            float depth = 0.0f;
+            float hits = 0.0f;
+            const ne::abstract::Material* material = nullptr;
+
+            static FirstHit make(bool found, const ne::Ray& ray,
+                const ne::Intersection& hit);
+
+            // sum, keeps the material of the first ray that hit
+            FirstHit& operator+=(const FirstHit& other) {
+                albedo += other.albedo;
+                normal += other.normal;
+                depth += other.depth;
+                hits += other.hits;
+                if (!material)
+                    material = other.material;
+                return *this;
+            }
+        };
+
+        // Russian roulette decision shared by the integrators. Returns false
+        // when the path dies, otherwise reweights throughput.
+        bool russianRoulette(const IntegratorSettings& settings, int bounces,
+            glm::vec3& throughput, ne::Sampler& sampler);
+
         class Integrator {
         public:
-            // integration part of rendering equation
+            explicit Integrator(const IntegratorSettings& settings = IntegratorSettings())
+                : settings_(settings) {}
+
+            // integration part of rendering equation. firstHit, if given,
+            // receives the surface the camera ray hit.
             virtual glm::vec3 integrate(const ne::Ray& ray,
-                std::shared_ptr<ne::Scene> scene);
+                const std::shared_ptr<ne::Scene>& scene, ne::Sampler& sampler,
+                FirstHit* firstHit = nullptr);
+
+            // Traces the camera rays of up to RayPacket::width paths as one
+            // packet, then follows every path on its own. Lane i uses
+            // samplers[i] and writes radiance[i]; each path consumes its
+            // sampler exactly like integrate(), so images do not change.
+            // firstHits, if given, receives the first hit of every lane.
+            void integrate(ne::RayPacket& packet,
+                const std::shared_ptr<ne::Scene>& scene,
+                ne::Sampler* const* samplers, glm::vec3* radiance,
+                FirstHit* firstHits = nullptr);
+
+            const PathStatistics& statistics() const { return statistics_; }
+
+        protected:
+            // path whose camera ray was already traced: ray carries the hit
+            // distance, found and hit the result of the trace
+            glm::vec3 continuePath(const ne::Ray& ray, bool found,
+                const ne::Intersection& hit,
+                const std::shared_ptr<ne::Scene>& scene, ne::Sampler& sampler);
+
+            IntegratorSettings settings_;
+            PathStatistics statistics_;
         };
 
     } // namespace core
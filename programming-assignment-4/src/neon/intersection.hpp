@@ -9,9 +9,11 @@ namespace ne {
 // Intersection(or HitRecord or Per ray data) class record information around
 // the hit point. you can easily extend intersection class by using polymorphism
 struct Intersection {
-  glm::vec3 p;                  // position at hit point
-  glm::vec3 n;                  // normal at hit point
-  ne::MaterialPointer material; // pointer to material at hit point
+  glm::vec3 p; // position at hit point
+  glm::vec3 n; // normal at hit point
+  // material at hit point. Non owning, the material table of the scene keeps
+  // it alive, so copying a hit costs no reference counting.
+  const ne::abstract::Material *material = nullptr;
 };
 
 } // namespace ne
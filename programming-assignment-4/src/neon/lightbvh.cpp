@@ -0,0 +1,213 @@
+#include "neon/lightbvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ne {
+
+namespace {
+
+float safeSqrt(float x) { return std::sqrt(std::max(0.0f, x)); }
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from sines and cosines
+float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+  if (cosA > cosB)
+    return 1.0f;
+  return cosA * cosB + sinA * sinB;
+}
+
+float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+  if (cosA > cosB)
+    return 0.0f;
+  return sinA * cosB - cosA * sinB;
+}
+
+glm::vec3 rotate(const glm::vec3 &v, const glm::vec3 &axis, float angle) {
+  // Rodrigues' formula
+  const float c = std::cos(angle), s = std::sin(angle);
+  return v * c + glm::cross(axis, v) * s + axis * glm::dot(axis, v) * (1 - c);
+}
+
+} // namespace
+
+LightBounds LightBounds::sphere(const glm::vec3 &center, float radius,
+                                float power) {
+  LightBounds light;
+  light.bounds = ne::AABB(center - glm::vec3(radius), center + glm::vec3(radius));
+  light.power = power;
+  // normals point everywhere, each emits into its hemisphere
+  light.cosThetaO = -1.0f;
+  light.cosThetaE = 0.0f;
+  return light;
+}
+
+LightBounds LightBounds::merge(const LightBounds &a, const LightBounds &b) {
+  if (a.power <= 0.0f)
+    return b;
+  if (b.power <= 0.0f)
+    return a;
+
+  LightBounds out;
+  out.bounds = a.bounds;
+  out.bounds.expand(b.bounds);
+  out.power = a.power + b.power;
+  out.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+
+  // smallest cone around both orientation cones
+  const float thetaA = std::acos(glm::clamp(a.cosThetaO, -1.0f, 1.0f));
+  const float thetaB = std::acos(glm::clamp(b.cosThetaO, -1.0f, 1.0f));
+  const float thetaD =
+      std::acos(glm::clamp(glm::dot(a.axis, b.axis), -1.0f, 1.0f));
+  const float pi = 3.14159265358979323846f;
+  if (std::min(thetaD + thetaB, pi) <= thetaA) {
+    out.axis = a.axis;
+    out.cosThetaO = a.cosThetaO;
+  } else if (std::min(thetaD + thetaA, pi) <= thetaB) {
+    out.axis = b.axis;
+    out.cosThetaO = b.cosThetaO;
+  } else {
+    const float thetaO = (thetaA + thetaD + thetaB) / 2.0f;
+    const glm::vec3 r = glm::cross(a.axis, b.axis);
+    if (thetaO >= pi || glm::dot(r, r) == 0.0f) {
+      out.cosThetaO = -1.0f;
+      out.axis = a.axis;
+    } else {
+      out.axis = rotate(a.axis, glm::normalize(r), thetaO - thetaA);
+      out.cosThetaO = std::cos(thetaO);
+    }
+  }
+  return out;
+}
+
+float LightBounds::importance(const glm::vec3 &p, const glm::vec3 &n) const {
+  const glm::vec3 center = bounds.centroid();
+  const glm::vec3 toPoint = p - center;
+  float d2 = glm::dot(toPoint, toPoint);
+  // points inside or next to the cluster must not get infinite importance
+  d2 = std::max(d2, glm::length(bounds.extent()) / 2.0f);
+
+  // angle the bounding sphere subtends from p
+  const float radius2 = glm::dot(bounds.max - center, bounds.max - center);
+  const float dist2 = glm::dot(toPoint, toPoint);
+  float cosThetaB = -1.0f;
+  if (dist2 > radius2)
+    cosThetaB = safeSqrt(1.0f - radius2 / dist2);
+  const float sinThetaB = safeSqrt(1.0f - cosThetaB * cosThetaB);
+
+  // smallest angle between an emitter normal and the direction towards p
+  const glm::vec3 wi = dist2 > 0.0f ? toPoint / std::sqrt(dist2) : n;
+  const float cosThetaW = glm::dot(axis, wi);
+  const float sinThetaW = safeSqrt(1.0f - cosThetaW * cosThetaW);
+  const float sinThetaO = safeSqrt(1.0f - cosThetaO * cosThetaO);
+  const float cosThetaX =
+      cosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+  const float sinThetaX =
+      sinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+  const float cosThetaP =
+      cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+  if (cosThetaP <= cosThetaE)
+    return 0.0f;
+
+  // only the front of the receiving surface is lit
+  const float cosThetaI = glm::dot(-wi, n);
+  const float sinThetaI = safeSqrt(1.0f - cosThetaI * cosThetaI);
+  const float cosThetaPI =
+      cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+  return std::max(0.0f, power * cosThetaP * cosThetaPI / d2);
+}
+
+void LightBVH::clear() {
+  bvh_.clear();
+  nodes_.clear();
+  lights_.clear();
+}
+
+void LightBVH::build(const std::vector<LightBounds> &lights) {
+  clear();
+  if (lights.empty())
+    return;
+
+  std::vector<ne::AABB> bounds;
+  bounds.reserve(lights.size());
+  for (const LightBounds &light : lights)
+    bounds.push_back(light.bounds);
+  // one light per leaf, so sampling mostly ends at a single light. Leaves
+  // at the depth limit of the builder may still hold several.
+  bvh_.build(bounds, 1);
+  lights_.reserve(lights.size());
+  for (uint32_t i : bvh_.indices())
+    lights_.push_back(lights[i]);
+
+  // children are stored after their parent
+  const std::vector<ne::BVH::Node> &nodes = bvh_.nodes();
+  nodes_.resize(nodes.size());
+  for (size_t i = nodes.size(); i-- > 0;) {
+    if (nodes[i].count > 0) {
+      nodes_[i] = lights_[nodes[i].offset];
+      for (uint32_t k = 1; k < nodes[i].count; ++k)
+        nodes_[i] = LightBounds::merge(nodes_[i], lights_[nodes[i].offset + k]);
+    } else {
+      nodes_[i] = LightBounds::merge(nodes_[i + 1], nodes_[nodes[i].offset]);
+    }
+  }
+}
+
+int LightBVH::sample(const glm::vec3 &p, const glm::vec3 &n, float u,
+                     float &pmf) const {
+  pmf = 0.0f;
+  if (empty())
+    return -1;
+
+  const std::vector<ne::BVH::Node> &nodes = bvh_.nodes();
+  uint32_t current = 0;
+  float probability = 1.0f;
+  while (nodes[current].count == 0) {
+    const uint32_t children[2] = {current + 1, nodes[current].offset};
+    const float left = nodes_[children[0]].importance(p, n);
+    const float right = nodes_[children[1]].importance(p, n);
+    if (left <= 0.0f && right <= 0.0f)
+      return -1;
+    // reuse u for the next level after remapping it to [0, 1)
+    const float pLeft = left / (left + right);
+    if (u < pLeft) {
+      u = std::min(u / pLeft, 0x1.fffffep-1f);
+      probability *= pLeft;
+      current = children[0];
+    } else {
+      u = std::min((u - pLeft) / (1.0f - pLeft), 0x1.fffffep-1f);
+      probability *= 1.0f - pLeft;
+      current = children[1];
+    }
+  }
+
+  // the lights of a leaf are picked like children, in proportion to their
+  // importance
+  uint32_t pick = nodes[current].offset;
+  if (nodes[current].count > 1) {
+    const uint32_t first = nodes[current].offset;
+    const uint32_t end = first + nodes[current].count;
+    float total = 0.0f;
+    for (uint32_t i = first; i < end; ++i)
+      total += lights_[i].importance(p, n);
+    if (total <= 0.0f)
+      return -1;
+    float target = u * total;
+    float weight = 0.0f;
+    for (uint32_t i = first; i < end; ++i) {
+      const float w = lights_[i].importance(p, n);
+      if (w <= 0.0f)
+        continue;
+      // the last light with weight takes what rounding leaves over
+      pick = i;
+      weight = w;
+      if (target < w)
+        break;
+      target -= w;
+    }
+    probability *= weight / total;
+  }
+  pmf = probability;
+  return static_cast<int>(bvh_.indices()[pick]);
+}
+
+} // namespace ne
@@ -0,0 +1,60 @@
+#ifndef __LIGHTBVH_H_
+#define __LIGHTBVH_H_
+
+#include "neon/aabb.hpp"
+#include "neon/bvh.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ne {
+
+// Spatial, power and orientation bounds of one light or of a cluster of
+// lights. The emitters lie inside bounds and face directions within
+// cosThetaO of axis; each emits into a further cosThetaE around its normal
+// (Conty Estevez and Kulla 2018).
+struct LightBounds {
+  ne::AABB bounds;
+  float power = 0.0f;
+  glm::vec3 axis{0.0f, 0.0f, 1.0f};
+  float cosThetaO = 1.0f;
+  float cosThetaE = 1.0f;
+
+  /// spherical emitter, radiates from every point of its surface
+  static LightBounds sphere(const glm::vec3 &center, float radius,
+                            float power);
+  static LightBounds merge(const LightBounds &a, const LightBounds &b);
+
+  /// Estimate of the light reaching p on a surface with normal n. 0 when no
+  /// emitter inside the bounds can light the front side of the surface.
+  float importance(const glm::vec3 &p, const glm::vec3 &n) const;
+};
+
+// Light hierarchy for many-light sampling. Lights are clustered with the
+// scene BVH builder; every node keeps the LightBounds of its subtree, and a
+// light is picked by descending from the root into each child with a
+// probability proportional to its importance for the shading point. Costs
+// O(log lights) per sample regardless of how many lights there are.
+class LightBVH {
+public:
+  void build(const std::vector<LightBounds> &lights);
+  void clear();
+  bool empty() const { return bvh_.empty(); }
+  size_t size() const { return bvh_.indices().size(); }
+
+  /// Pick a light for the shading point p with normal n using one uniform
+  /// number u. Returns the index into the lights given to build() and its
+  /// probability in pmf, or -1 if no light can reach the point.
+  int sample(const glm::vec3 &p, const glm::vec3 &n, float u,
+             float &pmf) const;
+
+private:
+  ne::BVH bvh_;
+  std::vector<LightBounds> nodes_;  // parallel to bvh_.nodes()
+  std::vector<LightBounds> lights_; // parallel to bvh_.indices()
+};
+
+} // namespace ne
+
+#endif // __LIGHTBVH_H_
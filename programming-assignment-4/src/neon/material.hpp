@@ -4,23 +4,56 @@
 #include "neon/blueprint.hpp"
 #include "neon/intersection.hpp"
 #include "neon/ray.hpp"
+#include "neon/sampler.hpp"
+#include "neon/stats.hpp"
+
+#include <cmath>
+#include <glm/gtc/constants.hpp>
 
 namespace ne {
 
+    class DiffuseLight;
+    class Dielectric;
+    class Lambertian;
+    class Metal;
+
     namespace abstract {
 
         // Absract material class for inteface
         // you can add/change variables/methods if you want
         class Material {
         public:
+            // built-in materials, see ne::visit. Everything else is Custom
+            enum class Kind { Lambertian, Metal, Dielectric, DiffuseLight, Custom };
+
+            Material() = default;
+            virtual ~Material() = default;
+
+            Kind kind() const { return kind_; }
+
+            // sampler is the random number stream of the current path
             virtual bool scatter(const ne::Ray& r_in, const ne::Intersection& hit,
-                ne::Ray& r_out) const = 0;
+                ne::Ray& r_out, ne::Sampler& sampler) const = 0;
 
             virtual glm::vec3 emitted() const { return glm::vec3{ 0, 0, 0 }; }
 
             virtual glm::vec3 attenuation() const = 0;
 
         protected:
+            // Only the built-in materials can make a BuiltIn, so no other class
+            // can claim their kind and be cast to one of them by ne::visit.
+            class BuiltIn {
+                BuiltIn() {}
+                friend class ne::DiffuseLight;
+                friend class ne::Dielectric;
+                friend class ne::Lambertian;
+                friend class ne::Metal;
+            };
+
+            Material(Kind kind, BuiltIn) : kind_(kind) {}
+
+        private:
+            Kind kind_ = Kind::Custom;
         };
 
     } // namespace abstract
@@ -31,10 +64,11 @@ namespace ne {
     // Light material which glow unifomly.
     class DiffuseLight final : public ne::abstract::Material{
     public:
-      DiffuseLight(const glm::vec3 & color = glm::vec3(1.0)) : color_(color) {}
+      DiffuseLight(const glm::vec3 & color = glm::vec3(1.0))
+          : Material(Kind::DiffuseLight, BuiltIn()), color_(color) {}
 
       bool scatter(const ne::Ray & r_in, const ne::Intersection & hit,
-                   ne::Ray & r_out) const override;
+                   ne::Ray & r_out, ne::Sampler & sampler) const override;
 
       glm::vec3 emitted() const override;
 
@@ -49,10 +83,10 @@ namespace ne {
     class Dielectric final : public ne::abstract::Material{
     public:
       Dielectric(const glm::vec3 & color = glm::vec3(0.7), float IOR = 0.7f)
-          : color_(color), IOR_(IOR) {}
+          : Material(Kind::Dielectric, BuiltIn()), color_(color), IOR_(IOR) {}
 
       bool scatter(const ne::Ray & r_in, const ne::Intersection & hit,
-                   ne::Ray & r_out) const override;
+                   ne::Ray & r_out, ne::Sampler & sampler) const override;
 
       glm::vec3 attenuation() const override;
 
@@ -67,10 +101,10 @@ namespace ne {
     class Lambertian final : public ne::abstract::Material{
     public:
       Lambertian(const glm::vec3 color = glm::vec3{0.f, 0.f, 0.f})
-          : color_(color) {}
+          : Material(Kind::Lambertian, BuiltIn()), color_(color) {}
 
       bool scatter(const ne::Ray & r_in, const ne::Intersection & hit,
-                   ne::Ray & r_out) const override;
+                   ne::Ray & r_out, ne::Sampler & sampler) const override;
 
       glm::vec3 attenuation() const override;
 
@@ -82,10 +116,10 @@ namespace ne {
     class Metal final : public ne::abstract::Material{
     public:
       Metal(const glm::vec3 color = glm::vec3{0.0f, 0.0f, 0.f}, float blurr = 0.2f)
-          : color_(color), roughness_(glm::clamp(blurr, 0.0f, 1.0f)) {}
+          : Material(Kind::Metal, BuiltIn()), color_(color), roughness_(glm::clamp(blurr, 0.0f, 1.0f)) {}
 
       bool scatter(const ne::Ray & r_in, const ne::Intersection & hit,
-                   ne::Ray & r_out) const override;
+                   ne::Ray & r_out, ne::Sampler & sampler) const override;
 
       glm::vec3 attenuation() const override;
 
@@ -94,6 +128,168 @@ namespace ne {
       float roughness_ = 0.0f;
     };
 
+    // Static dispatch over the built-in materials: calls fn with the concrete
+    // type, so their (final, inline) methods can be inlined into the caller
+    // instead of going through the vtable. Custom materials get the abstract
+    // interface and keep virtual dispatch.
+    template <typename Fn>
+    decltype(auto) visit(const ne::abstract::Material& material, Fn&& fn) {
+        using Kind = ne::abstract::Material::Kind;
+        switch (material.kind()) {
+        case Kind::Lambertian:
+            return fn(static_cast<const Lambertian&>(material));
+        case Kind::Metal:
+            return fn(static_cast<const Metal&>(material));
+        case Kind::Dielectric:
+            return fn(static_cast<const Dielectric&>(material));
+        case Kind::DiffuseLight:
+            return fn(static_cast<const DiffuseLight&>(material));
+        default:
+            return fn(material);
+        }
+    }
+
+    inline bool scatter(const ne::abstract::Material& material, const ne::Ray& r_in,
+        const ne::Intersection& hit, ne::Ray& r_out, ne::Sampler& sampler) {
+        ne::stats::add(static_cast<ne::stats::Counter>(
+            static_cast<uint32_t>(ne::stats::Counter::ScatterLambertian) +
+            static_cast<uint32_t>(material.kind())));
+        return visit(material, [&](const auto& m) { return m.scatter(r_in, hit, r_out, sampler); });
+    }
+
+    inline glm::vec3 emitted(const ne::abstract::Material& material) {
+        return visit(material, [](const auto& m) { return m.emitted(); });
+    }
+
+    inline glm::vec3 attenuation(const ne::abstract::Material& material) {
+        return visit(material, [](const auto& m) { return m.attenuation(); });
+    }
+
+    /*  Inline so that ne::visit can inline them  */
+
+    inline bool DiffuseLight::scatter(const ne::Ray& r_in, const ne::Intersection& hit,
+        ne::Ray& r_out, ne::Sampler& sampler) const {
+     
+        return false;
+    }
+
+    inline glm::vec3 DiffuseLight::emitted() const {
+       
+        return glm::vec3(1.0f, 1.0f, 1.0f); 
+    }
+
+    inline glm::vec3 DiffuseLight::attenuation() const {
+       
+        return glm::vec3(0.0f);
+    }
+
+    inline bool Dielectric::scatter(const ne::Ray& r_in, const ne::Intersection& hit,
+        ne::Ray& r_out, ne::Sampler& sampler) const {
+        // Implement your code
+        glm::vec3 outward_normal;
+        glm::vec3 reflected = glm::reflect(r_in.dir, hit.n);
+        glm::vec3 refracted(0.0f);
+        float ni_over_nt;
+        float cosine;
+        float reflect_prob;
+       
+        if (glm::dot(r_in.dir, hit.n) > 0) {
+            outward_normal = -hit.n;
+            ni_over_nt = IOR_;
+            cosine = IOR_ * glm::dot(r_in.dir, hit.n) / glm::length(r_in.dir);
+        }
+        else {
+            outward_normal = hit.n;
+            ni_over_nt = 1.0 / IOR_;
+            cosine = -glm::dot(r_in.dir, hit.n) / glm::length(r_in.dir);
+        }
+
+        if (refract(r_in.dir, outward_normal, ni_over_nt, refracted)) {
+            reflect_prob = schlick(cosine, IOR_);
+        }
+        else {
+            reflect_prob = 1.0;
+        }
+
+        if (sampler.next1D() < reflect_prob) {
+            r_out = ne::Ray(hit.p, reflected);
+        }
+        else {
+            r_out = ne::Ray(hit.p, refracted);
+        }
+
+        return true;
+    }
+
+    inline glm::vec3 Dielectric::attenuation() const {
+        // implement your code
+        return glm::vec3(1.0f);
+    }
+
+    inline bool Dielectric::refract(const glm::vec3& v, const glm::vec3& n, float ni_over_nt, glm::vec3& refracted) {
+        glm::vec3 uv = glm::normalize(v);
+        float dt = glm::dot(uv, n);
+        float discriminant = 1.0f - ni_over_nt * ni_over_nt * (1.0f - dt * dt);
+        if (discriminant > 0) {
+            refracted = ni_over_nt * (uv - n * dt) - n * std::sqrt(discriminant);
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+
+    inline float Dielectric::schlick(float cosine, float ref_idx) {
+        float r0 = (1.0f - ref_idx) / (1.0f + ref_idx);
+        r0 = r0 * r0;
+        return r0 + (1.0f - r0) * pow((1.0f - cosine), 5);
+    }
+
+    inline bool Lambertian::scatter(const ne::Ray& r_in, const ne::Intersection& hit,
+        ne::Ray& r_out, ne::Sampler& sampler) const {
+        // Implement your code
+        // Calculate scatter direction
+        glm::vec3 scatter_direction = hit.n + sampler.sphere();
+
+        // Check for degenerate scatter direction
+        if (glm::length(scatter_direction) < 1e-8) {
+            scatter_direction = hit.n;
+        }
+
+        r_out = ne::Ray(hit.p, scatter_direction);
+        return true;
+    }
+
+    inline glm::vec3 Lambertian::attenuation() const {
+        // implement your code
+        return color_;
+    }
+
+
+    inline bool Metal::scatter(const ne::Ray& r_in, const ne::Intersection& hit,
+        ne::Ray& r_out, ne::Sampler& sampler) const {
+        // Implement your code
+        // Reflect the incoming ray direction around the normal
+        glm::vec3 reflected = glm::reflect(glm::normalize(r_in.dir), hit.n);
+
+        // Add some fuzziness based on the roughness
+        glm::vec3 scatter_direction = reflected + roughness_ * sampler.sphere();
+
+        // Ensure the scattered ray is still in the correct direction
+        if (glm::dot(scatter_direction, hit.n) > 0) {
+            r_out = ne::Ray(hit.p, scatter_direction);
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+
+    inline glm::vec3 Metal::attenuation() const {
+        // implement your code
+        return color_;
+    }
+
 } // namespace ne
 
 #endif // __MATERIAL_H_
@@ -0,0 +1,176 @@
+#ifndef __RAYPACKET_H_
+#define __RAYPACKET_H_
+
+#include "neon/aabb.hpp"
+#include "neon/ray.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) ||            \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NE_PACKET_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace ne {
+
+// Group of coherent rays traced through a BVH together, e.g. the camera rays
+// of neighbouring pixels. The rays stay usable on their own (leaf callbacks
+// and shading take rays[i]); origins, inverse directions and t are mirrored
+// as structure of arrays so a node is tested against all lanes in one loop.
+struct RayPacket {
+  inline static constexpr int width = 8;
+
+  ne::Ray rays[width];
+  uint32_t valid = 0; // lanes in use
+
+  alignas(32) float ox[width], oy[width], oz[width];
+  alignas(32) float ix[width], iy[width], iz[width];
+  alignas(32) float t[width];
+
+  /// Use the first count rays. Must be called after filling rays and before
+  /// tracing; unused lanes get a copy of lane 0 so the box loop stays full.
+  void setup(int count) {
+    valid = count >= width ? (1u << width) - 1u : (1u << count) - 1u;
+    for (int i = 0; i < width; ++i) {
+      const ne::Ray &r = rays[i < count ? i : 0];
+      const glm::vec3 inv = 1.0f / r.dir;
+      ox[i] = r.o.x;
+      oy[i] = r.o.y;
+      oz[i] = r.o.z;
+      ix[i] = inv.x;
+      iy[i] = inv.y;
+      iz[i] = inv.z;
+      t[i] = i < count ? r.t : -1.0f;
+    }
+  }
+
+  /// leaf callbacks shrink rays[lane].t, this keeps the box test in sync
+  void updateT(int lane) { t[lane] = rays[lane].t; }
+
+  /// True when the lanes in mask share the sign of every direction component,
+  /// so they visit the children of a node in the same order and the packet
+  /// bounds below are tight enough to cull.
+  bool coherent(uint32_t mask) const {
+    int signs = -1;
+    for (int i = 0; i < width; ++i) {
+      if (!(mask & (1u << i)))
+        continue;
+      const int s = std::signbit(ix[i]) | std::signbit(iy[i]) << 1 |
+                    std::signbit(iz[i]) << 2;
+      if (signs >= 0 && s != signs)
+        return false;
+      signs = s;
+    }
+    return true;
+  }
+
+  /// Slab test of every lane against box, same arithmetic as AABB::hit.
+  /// Returns the lanes of mask that overlap the box within [0, t].
+  uint32_t hit(const ne::AABB &box, uint32_t mask) const {
+#ifdef NE_PACKET_SSE
+    // a slab giving NaN (origin on the slab, direction parallel to it) does
+    // not limit the ray, as in AABB::hit: unordered lanes keep their bounds
+    const __m128 lo[3] = {_mm_set1_ps(box.min.x), _mm_set1_ps(box.min.y),
+                          _mm_set1_ps(box.min.z)};
+    const __m128 hi[3] = {_mm_set1_ps(box.max.x), _mm_set1_ps(box.max.y),
+                          _mm_set1_ps(box.max.z)};
+    const float *o[3] = {ox, oy, oz};
+    const float *inv[3] = {ix, iy, iz};
+    uint32_t result = 0;
+    for (int k = 0; k < width; k += 4) {
+      __m128 tmin = _mm_set1_ps(-std::numeric_limits<float>::max());
+      __m128 tmax = _mm_set1_ps(std::numeric_limits<float>::max());
+      for (int a = 0; a < 3; ++a) {
+        const __m128 origin = _mm_load_ps(o[a] + k);
+        const __m128 invDir = _mm_load_ps(inv[a] + k);
+        const __m128 t0 = _mm_mul_ps(_mm_sub_ps(lo[a], origin), invDir);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(hi[a], origin), invDir);
+        const __m128 ordered = _mm_cmpord_ps(t0, t1);
+        tmin = _mm_or_ps(
+            _mm_and_ps(ordered, _mm_max_ps(_mm_min_ps(t0, t1), tmin)),
+            _mm_andnot_ps(ordered, tmin));
+        tmax = _mm_or_ps(
+            _mm_and_ps(ordered, _mm_min_ps(_mm_max_ps(t1, t0), tmax)),
+            _mm_andnot_ps(ordered, tmax));
+      }
+      tmax = _mm_mul_ps(tmax, _mm_set1_ps(ne::AABB::robustScale_));
+      const __m128 overlap = _mm_and_ps(
+          _mm_cmpge_ps(tmax, _mm_max_ps(tmin, _mm_setzero_ps())),
+          _mm_cmple_ps(tmin, _mm_load_ps(t + k)));
+      result |= uint32_t(_mm_movemask_ps(overlap)) << k;
+    }
+    return result & mask;
+#else
+    uint32_t result = 0;
+    for (int i = 0; i < width; ++i) {
+      float tNear;
+      const bool overlap = box.hit(glm::vec3(ox[i], oy[i], oz[i]),
+                                   glm::vec3(ix[i], iy[i], iz[i]), t[i], tNear);
+      result |= uint32_t(overlap) << i;
+    }
+    return result & mask;
+#endif
+  }
+};
+
+// Conservative bounds of a coherent packet: intervals of its origins and
+// inverse directions per axis (Boulos et al. 2006). A box that no ray in
+// these intervals can hit is skipped without looking at single lanes.
+struct PacketFrustum {
+  glm::vec3 oMin, oMax, iMin, iMax;
+  bool finite[3]; // false: some lane is parallel to the slabs of this axis
+
+  PacketFrustum(const RayPacket &packet, uint32_t mask) {
+    oMin = iMin = glm::vec3(std::numeric_limits<float>::max());
+    oMax = iMax = glm::vec3(-std::numeric_limits<float>::max());
+    for (int i = 0; i < RayPacket::width; ++i) {
+      if (!(mask & (1u << i)))
+        continue;
+      const glm::vec3 o(packet.ox[i], packet.oy[i], packet.oz[i]);
+      const glm::vec3 inv(packet.ix[i], packet.iy[i], packet.iz[i]);
+      oMin = glm::min(oMin, o);
+      oMax = glm::max(oMax, o);
+      iMin = glm::min(iMin, inv);
+      iMax = glm::max(iMax, inv);
+    }
+    for (int a = 0; a < 3; ++a)
+      finite[a] = std::isfinite(iMin[a]) && std::isfinite(iMax[a]);
+  }
+
+  /// False only if no ray of the packet can overlap box within [0, tMax].
+  bool mayHit(const ne::AABB &box, float tMax) const {
+    float nearLo = 0.0f;
+    float farHi = tMax;
+    for (int a = 0; a < 3; ++a) {
+      if (!finite[a])
+        continue;
+      // all lanes share the sign, so the near plane is the same for all
+      const bool negative = iMax[a] < 0.0f;
+      const float nearPlane = negative ? box.max[a] : box.min[a];
+      const float farPlane = negative ? box.min[a] : box.max[a];
+      nearLo = std::max(nearLo, lower(nearPlane - oMax[a],
+                                      nearPlane - oMin[a], iMin[a], iMax[a]));
+      farHi = std::min(farHi, upper(farPlane - oMax[a], farPlane - oMin[a],
+                                    iMin[a], iMax[a]));
+    }
+    return nearLo <= farHi * ne::AABB::robustScale_;
+  }
+
+private:
+  // bounds of the product of the intervals [a0, a1] and [b0, b1]
+  static float lower(float a0, float a1, float b0, float b1) {
+    return std::min(std::min(a0 * b0, a0 * b1), std::min(a1 * b0, a1 * b1));
+  }
+  static float upper(float a0, float a1, float b0, float b1) {
+    return std::max(std::max(a0 * b0, a0 * b1), std::max(a1 * b0, a1 * b1));
+  }
+};
+
+} // namespace ne
+
+#endif // __RAYPACKET_H_
@@ -1,9 +1,13 @@
 #ifndef __RENDABLE_H_
 #define __RENDABLE_H_
 
+#include "neon/aabb.hpp"
 #include "neon/blueprint.hpp"
 #include "neon/intersection.hpp"
 #include "neon/ray.hpp"
+#include "neon/raypacket.hpp"
+
+#include <vector>
 
 namespace ne {
 
@@ -16,6 +20,35 @@ public:
   Rendable(MaterialPointer m = nullptr) : material_(m) {}
   virtual ~Rendable() {}
   virtual bool rayIntersect(ne::Ray &ray, ne::Intersection &inter) = 0;
+  /// Any hit test against the segment [eps_, ray.t]. Never touches an
+  /// Intersection, override it when a cheaper test exists.
+  virtual bool occluded(const ne::Ray &ray) {
+    ne::Ray r = ray;
+    ne::Intersection tmp;
+    return rayIntersect(r, tmp);
+  }
+  /// Closest hits of the lanes in mask of a ray packet, rayIntersect for
+  /// each lane. Shrinks packet.rays[i].t and keeps packet.t in sync, returns
+  /// the lanes that hit. Override it when lanes can share work.
+  virtual uint32_t intersectPacket(ne::RayPacket &packet, uint32_t mask,
+                                   ne::Intersection *hits) {
+    uint32_t found = 0;
+    for (int i = 0; i < ne::RayPacket::width; ++i) {
+      if ((mask & (1u << i)) && rayIntersect(packet.rays[i], hits[i])) {
+        packet.updateT(i);
+        found |= 1u << i;
+      }
+    }
+    return found;
+  }
+  /// World space bounds, used to build the scene BVH
+  virtual ne::AABB bounds() const = 0;
+  /// Append every material a hit on this object can report. Aggregates
+  /// override it so the scene can register the materials of their children.
+  virtual void collectMaterials(std::vector<MaterialPointer> &out) const {
+    if (material_)
+      out.push_back(material_);
+  }
   //virtual glm::vec3 sample() const = 0; // sample ޼ҵ ߰
 
   // You need c++ 17 compiler for inline static initilization
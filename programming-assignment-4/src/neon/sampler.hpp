@@ -0,0 +1,59 @@
+#ifndef __SAMPLER_H_
+#define __SAMPLER_H_
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+namespace ne {
+
+// Per path random number generator (PCG32, see pcg-random.org). It is cheap
+// to construct and owns all of its state, so every pixel gets its own stream:
+// Sampler(seed, pixelIndex). Renders then only depend on the seed, not on the
+// number of threads or the order in which tiles are scheduled.
+class Sampler {
+public:
+  explicit Sampler(uint64_t seed = 0, uint64_t stream = 0) {
+    this->seed(seed, stream);
+  }
+
+  inline void seed(uint64_t seed, uint64_t stream) {
+    state_ = 0u;
+    inc_ = (stream << 1u) | 1u;
+    nextUInt();
+    state_ += seed;
+    nextUInt();
+  }
+
+  inline uint32_t nextUInt() {
+    const uint64_t old = state_;
+    state_ = old * 6364136223846793005ULL + inc_;
+    const uint32_t xorshifted =
+        static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+    const uint32_t rot = static_cast<uint32_t>(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
+  }
+
+  /// uniform float in [0, 1)
+  inline float next1D() {
+    return static_cast<float>(nextUInt() >> 8) * (1.0f / 16777216.0f);
+  }
+
+  inline glm::vec2 next2D() { return glm::vec2(next1D(), next1D()); }
+
+  /// uniform point on the sphere of given radius centered at the origin
+  inline glm::vec3 sphere(float radius = 1.0f) {
+    const float z = 1.0f - 2.0f * next1D();
+    const float r = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+    const float phi = glm::two_pi<float>() * next1D();
+    return radius * glm::vec3(r * glm::cos(phi), r * glm::sin(phi), z);
+  }
+
+  // raw state, e.g. for checkpoints
+  uint64_t state_ = 0;
+  uint64_t inc_ = 1;
+};
+
+} // namespace ne
+
+#endif // __SAMPLER_H_
@@ -1,9 +1,14 @@
 #include "neon/material.hpp"
 #include "neon/scene.hpp"
 #include "sphere.hpp"
+#include "neon/instance.hpp"
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include "neon/sampler.hpp"
+#include "neon/stats.hpp"
+#include "neon/trace.hpp"
+#include <algorithm>
 #include <iostream>
-#include <random>
 #include <cmath> // This includes the standard math library
 
 #ifndef M_PI
@@ -14,70 +19,399 @@ namespace ne {
 
     void Scene::add(ne::RendablePointer object) {
         objects_.push_back(object);
-        if (glm::length(object->material_->emitted()) > 0.0f) {
+        built_ = false;
+        lightBvh_.clear();
+
+        // own the materials here so hits can refer to them by raw pointer.
+        // Groups and instances report the materials of their children.
+        std::vector<ne::MaterialPointer> materials;
+        object->collectMaterials(materials);
+        for (const auto& material : materials) {
+            if (materialIndex_.emplace(material.get(), static_cast<uint32_t>(materials_.size())).second) {
+                materials_.push_back(material);
+            }
+        }
+
+        // only spheres can be sampled as lights
+        if (object->material_ && glm::length(ne::emitted(*object->material_)) > 0.0f &&
+            dynamic_cast<const Sphere*>(object.get())) {
             lights_.push_back(object);
         }
     }
 
+    void Scene::build() {
+        ne::trace::Scope span("scene build", "scene");
+        // spheres go to the packed SIMD store, everything else stays virtual
+        spheres_.clear();
+        primitives_.clear();
+        std::vector<ne::AABB> sphereBounds, primitiveBounds;
+        std::vector<const ne::abstract::Rendable*> sphereObjects;
+        for (const auto& o : objects_) {
+            if (const auto* s = dynamic_cast<const Sphere*>(o.get())) {
+                spheres_.add(*s);
+                sphereBounds.push_back(s->bounds());
+                sphereObjects.push_back(s);
+            }
+            else {
+                primitives_.push_back(o);
+                primitiveBounds.push_back(o->bounds());
+            }
+        }
+
+        // one kernel call tests a whole sphere leaf
+        sphereBvh_.build(sphereBounds, std::max(4u, spheres_.width()), builder_, buildThreads_);
+        bvh_.build(primitiveBounds, 4, builder_, buildThreads_);
+        // the wide BVHs may still move the binary leaves
+        buildWide();
+
+        // reorder objects so that every leaf refers to a contiguous range
+        spheres_.permute(sphereBvh_.indices());
+        std::vector<ne::RendablePointer> ordered;
+        ordered.reserve(primitives_.size());
+        for (uint32_t i : bvh_.indices()) {
+            ordered.push_back(primitives_[i]);
+        }
+        primitives_.swap(ordered);
+
+        // where update() finds moved objects
+        slots_.clear();
+        const std::vector<uint32_t>& sphereOrder = sphereBvh_.indices();
+        for (uint32_t i = 0; i < sphereOrder.size(); ++i) {
+            slots_[sphereObjects[sphereOrder[i]]] = i | sphereSlot_;
+        }
+        for (uint32_t i = 0; i < primitives_.size(); ++i) {
+            slots_[primitives_[i].get()] = i;
+        }
+        movedSpheres_.clear();
+        movedPrimitives_.clear();
+        builtSahCost_[0] = sphereBvh_.sahCost();
+        builtSahCost_[1] = bvh_.sahCost();
+
+        buildLightBvh();
+        built_ = true;
+    }
+
+    void Scene::buildLightBvh() {
+        lightBvh_.clear();
+        lightsMoved_ = false;
+        if (!lightBvhEnabled_) {
+            return;
+        }
+        std::vector<ne::LightBounds> bounds;
+        bounds.reserve(lights_.size());
+        for (const auto& light : lights_) {
+            const auto* sphere = static_cast<const Sphere*>(light.get());
+            const glm::vec3 e = ne::emitted(*light->material_);
+            // emitted power up to a constant factor
+            const float luminance = 0.2126f * e.r + 0.7152f * e.g + 0.0722f * e.b;
+            const float area = 4.0f * static_cast<float>(M_PI) * sphere->radius_ * sphere->radius_;
+            bounds.push_back(ne::LightBounds::sphere(sphere->center_, sphere->radius_, luminance * area));
+        }
+        lightBvh_.build(bounds);
+    }
+
+    void Scene::buildWide() {
+        // the wide BVHs reuse the leaves of the binary ones, which stay
+        // around for ray packets, and only change their order
+        sphereBvh8_.clear();
+        bvh8_.clear();
+        traverseWide_ = false;
+        if (wide_) {
+            traverseWide_ = sphereBvh8_.build(sphereBvh_) && bvh8_.build(bvh_);
+            if (!traverseWide_) {
+                std::cout << "Scene: leaves too large for the wide BVH, using the binary one" << std::endl;
+                sphereBvh8_.clear();
+                bvh8_.clear();
+            }
+        }
+    }
+
+    bool Scene::setPosition(const RendablePointer& object, const glm::vec3& position) {
+        if (const auto* instance = dynamic_cast<const Instance*>(object.get())) {
+            glm::mat4 toWorld = instance->toWorld();
+            toWorld[3] = glm::vec4(position, 1.0f);
+            return setTransform(object, toWorld);
+        }
+        return setTransform(object, glm::translate(glm::mat4(1.0f), position));
+    }
+
+    bool Scene::setTransform(const RendablePointer& object, const glm::mat4& toWorld) {
+        const auto slot = slots_.find(object.get());
+        if (!built_ || slot == slots_.end()) {
+            return false;
+        }
+        if (slot->second & sphereSlot_) {
+            // spheres keep their radius and only take the translation
+            auto* sphere = static_cast<Sphere*>(object.get());
+            sphere->center_ = glm::vec3(toWorld[3]);
+            const uint32_t i = slot->second & ~sphereSlot_;
+            spheres_.update(i, *sphere);
+            movedSpheres_.push_back(i);
+            if (sphere->material_ && glm::length(ne::emitted(*sphere->material_)) > 0.0f) {
+                lightsMoved_ = true;
+            }
+            return true;
+        }
+        auto* instance = dynamic_cast<Instance*>(object.get());
+        if (!instance) {
+            return false;
+        }
+        instance->setTransform(toWorld);
+        movedPrimitives_.push_back(slot->second);
+        return true;
+    }
+
+    bool Scene::update() {
+        ne::trace::Scope span("scene update", "scene");
+        if (!built_) {
+            build();
+            return true;
+        }
+        if (movedSpheres_.empty() && movedPrimitives_.empty()) {
+            return false;
+        }
+
+        sphereBvh_.refit(movedSpheres_, [&](uint32_t i) { return spheres_.bounds(i); });
+        bvh_.refit(movedPrimitives_, [&](uint32_t i) { return primitives_[i]->bounds(); });
+        movedSpheres_.clear();
+        movedPrimitives_.clear();
+
+        // refitted boxes overlap more and more as objects drift apart from
+        // the neighbours they were grouped with
+        const float limit = 1.0f + rebuildThreshold_;
+        if (sphereBvh_.sahCost() > builtSahCost_[0] * limit ||
+            bvh_.sahCost() > builtSahCost_[1] * limit) {
+            build();
+            return true;
+        }
+        // the quantized boxes are relative to their parents, encode them all
+        // again. The wide topology stays, like the binary one.
+        if (traverseWide_) {
+            sphereBvh8_.refit([&](uint32_t i) { return spheres_.bounds(i); });
+            bvh8_.refit([&](uint32_t i) { return primitives_[i]->bounds(); });
+        }
+        // there are far fewer lights than objects, rebuilding them is cheap
+        if (lightsMoved_) {
+            buildLightBvh();
+        }
+        return false;
+    }
+
+    size_t Scene::bvhMemory() const {
+        if (traverseWide_) {
+            return sphereBvh8_.memory() + bvh8_.memory();
+        }
+        return (sphereBvh_.nodes().size() + bvh_.nodes().size()) * sizeof(ne::BVH::Node);
+    }
+
     bool Scene::rayIntersect(ne::Ray& ray, ne::Intersection& inter) const { 
+        if (built_) {
+            auto sphereLeaf = [&](uint32_t first, uint32_t count, ne::Ray& r) {
+                return spheres_.rayIntersect(first, count, r, inter);
+            };
+            auto primitiveLeaf = [&](uint32_t first, uint32_t count, ne::Ray& r) {
+                bool hit = false;
+                for (uint32_t i = first; i < first + count; ++i) {
+                    hit = primitives_[i]->rayIntersect(r, inter) || hit;
+                }
+                return hit;
+            };
+            if (traverseWide_) {
+                bool found = sphereBvh8_.intersect(ray, sphereLeaf);
+                return bvh8_.intersect(ray, primitiveLeaf) || found;
+            }
+            bool found = sphereBvh_.intersect(ray, sphereLeaf);
+            return bvh_.intersect(ray, primitiveLeaf) || found;
+        }
+
         bool foundIntersection = false;
-        for (const auto o : objects_) {
+        for (const auto& o : objects_) {
             foundIntersection = o->rayIntersect(ray, inter) || foundIntersection;
         }
         return foundIntersection;
     }
 
+    uint32_t Scene::rayIntersect(ne::RayPacket& packet, ne::Intersection* hits) const {
+        if (!built_) {
+            uint32_t found = 0;
+            for (int i = 0; i < ne::RayPacket::width; ++i) {
+                if ((packet.valid & (1u << i)) && rayIntersect(packet.rays[i], hits[i])) {
+                    found |= 1u << i;
+                }
+            }
+            return found;
+        }
+
+        // spheres test the lanes that reached them one ray at a time,
+        // meshes traverse their own BVH with the packet
+        auto sphereLeaf = [&](uint32_t first, uint32_t count, ne::RayPacket& p, uint32_t mask) {
+            uint32_t hit = 0;
+            for (int i = 0; i < ne::RayPacket::width; ++i) {
+                if ((mask & (1u << i)) && spheres_.rayIntersect(first, count, p.rays[i], hits[i])) {
+                    p.updateT(i);
+                    hit |= 1u << i;
+                }
+            }
+            return hit;
+        };
+        auto primitiveLeaf = [&](uint32_t first, uint32_t count, ne::RayPacket& p, uint32_t mask) {
+            uint32_t hit = 0;
+            for (uint32_t j = first; j < first + count; ++j) {
+                hit |= primitives_[j]->intersectPacket(p, mask, hits);
+            }
+            return hit;
+        };
+        return sphereBvh_.intersect(packet, packet.valid, sphereLeaf) |
+            bvh_.intersect(packet, packet.valid, primitiveLeaf);
+    }
+
+    bool Scene::occluded(const glm::vec3& origin, const glm::vec3& target) const {
+        const glm::vec3 d = target - origin;
+        const float dist = glm::length(d);
+        if (dist <= shadowEps_) {
+            return false;
+        }
+
+        ne::stats::add(ne::stats::Counter::ShadowRays);
+        ne::Ray shadowRay(origin, d / dist);
+        shadowRay.t = dist - shadowEps_;
+
+        if (built_) {
+            auto sphereLeaf = [&](uint32_t first, uint32_t count, const ne::Ray& r) {
+                return spheres_.occluded(first, count, r);
+            };
+            auto primitiveLeaf = [&](uint32_t first, uint32_t count, const ne::Ray& r) {
+                for (uint32_t i = first; i < first + count; ++i) {
+                    if (primitives_[i]->occluded(r)) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+            if (traverseWide_) {
+                return sphereBvh8_.occluded(shadowRay, sphereLeaf) || bvh8_.occluded(shadowRay, primitiveLeaf);
+            }
+            return sphereBvh_.occluded(shadowRay, sphereLeaf) || bvh_.occluded(shadowRay, primitiveLeaf);
+        }
+
+        for (const auto& o : objects_) {
+            if (o->occluded(shadowRay)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     glm::vec3 Scene::sampleBackgroundLight(const glm::vec3& dir) const {
         glm::vec3 unit = glm::normalize(dir);
         float t = 0.5f * (unit.y + 1.0f);
         return ((1.0f - t) * glm::vec3(1.0f) + t * glm::vec3(0.5, 0.5, 0.9));
     }
 
-    glm::vec3 randomPointOnSphere(const glm::vec3& center, float radius) {
-        static std::mt19937 gen{ std::random_device{}() };
-        static std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-        float u = dist(gen);
-        float v = dist(gen);
-        float theta = 2.0f * M_PI * u;
-        float phi = acos(2.0f * v - 1.0f);
-        float x = center.x + (radius * sin(phi) * cos(theta));
-        float y = center.y + (radius * sin(phi) * sin(theta));
-        float z = center.z + (radius * cos(phi));
-        return glm::vec3(x, y, z);
+    // Point on the part of a spherical light visible from p, sampled uniformly
+    // in the cone of directions the sphere subtends (PBRT 4, section 6.2.4).
+    // pdf receives the solid angle density of the direction towards it, 0 when
+    // p is inside the sphere.
+    glm::vec3 sampleSphereCone(const glm::vec3& center, float radius, const glm::vec3& p,
+                               ne::Sampler& sampler, float& pdf) {
+        const float u = sampler.next1D();
+        const float v = sampler.next1D();
+        const glm::vec3 toCenter = center - p;
+        const float dc2 = glm::dot(toCenter, toCenter);
+        if (dc2 <= radius * radius) {
+            pdf = 0.0f;
+            return center;
+        }
+        const float dc = std::sqrt(dc2);
+        const float sin2ThetaMax = radius * radius / dc2;
+        const float cosThetaMax = std::sqrt(std::max(0.0f, 1.0f - sin2ThetaMax));
+        float oneMinusCosThetaMax = 1.0f - cosThetaMax;
+
+        float cosTheta = (cosThetaMax - 1.0f) * u + 1.0f;
+        float sin2Theta = 1.0f - cosTheta * cosTheta;
+        // small and distant lights: 1 - cos cancels, use the Taylor expansion
+        if (sin2ThetaMax < 0.00068523f) {
+            sin2Theta = sin2ThetaMax * u;
+            cosTheta = std::sqrt(1.0f - sin2Theta);
+            oneMinusCosThetaMax = sin2ThetaMax / 2.0f;
+        }
+        const float sinTheta = std::sqrt(std::max(0.0f, sin2Theta));
+        const float phi = 2.0f * static_cast<float>(M_PI) * v;
+
+        // orthonormal frame around the axis towards the center
+        const glm::vec3 w = toCenter / dc;
+        const glm::vec3 a = std::fabs(w.x) > 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+        const glm::vec3 s = glm::normalize(glm::cross(a, w));
+        const glm::vec3 t = glm::cross(w, s);
+        const glm::vec3 dir = sinTheta * std::cos(phi) * s + sinTheta * std::sin(phi) * t + cosTheta * w;
+
+        // first intersection of the direction with the sphere
+        const float dist = dc * cosTheta -
+            std::sqrt(std::max(0.0f, radius * radius - dc2 * sin2Theta));
+        pdf = 1.0f / (2.0f * static_cast<float>(M_PI) * oneMinusCosThetaMax);
+        return p + dist * dir;
     }
 
-    glm::vec3 Scene::sampleDirectLight(ne::Ray& ray, ne::Intersection& hit) const {
-        glm::vec3 lightResult(0.0f);
-        const int sampleCount = 10; // Number of samples for Monte Carlo Integration
+    void Scene::sampleLights(const ne::Intersection& hit, ne::Sampler& sampler,
+                             std::vector<ne::LightSample>& samples) const {
+        const int sampleCount = lightSampleCount_; // Number of samples for Monte Carlo Integration
 
-        for (auto& lightSource : lights_) {
-            auto lightSphere = std::dynamic_pointer_cast<Sphere>(lightSource);
-            glm::vec3 emittedColor = lightSource->material_->emitted(); // Use emitted color directly
-
-            int currentSample = 0;
-            while (currentSample < sampleCount) {
-                glm::vec3 pointOnLight = randomPointOnSphere(lightSphere->center_, lightSphere->radius_);
-                glm::vec3 shadowDir = glm::normalize(pointOnLight - hit.p);
-                ne::Ray shadowRay(hit.p, shadowDir);
-
-                glm::vec3 lightDirection = glm::normalize(pointOnLight - hit.p);
-                glm::vec3 hitNormal = hit.n;
-                float cosTheta = glm::dot(hitNormal, lightDirection);
-                float distSquared = glm::dot(pointOnLight - hit.p, pointOnLight - hit.p);
-
-                // Check for occlusion
-                ne::Intersection shadowHit;
-                bool isNotOccluded = !rayIntersect(shadowRay, shadowHit) || glm::distance(shadowHit.p, pointOnLight) < 0.001f;
-                if (cosTheta > 0.0f && distSquared > 0.0f && isNotOccluded) {
-                    lightResult += (cosTheta / distSquared) * emittedColor;
+        // one sample of one light, scale divides out how often it is drawn
+        auto sampleLight = [&](const ne::abstract::Rendable& lightSource, float scale) {
+            const auto* lightSphere = static_cast<const Sphere*>(&lightSource);
+            glm::vec3 emittedColor = ne::emitted(*lightSource.material_); // Use emitted color directly
+
+            // every sample lands on the side of the light facing the hit,
+            // so no shadow ray is spent on the back of the sphere
+            float pdf;
+            glm::vec3 pointOnLight = sampleSphereCone(lightSphere->center_, lightSphere->radius_, hit.p, sampler, pdf);
+
+            glm::vec3 lightDirection = glm::normalize(pointOnLight - hit.p);
+            glm::vec3 hitNormal = hit.n;
+            float cosTheta = glm::dot(hitNormal, lightDirection);
+
+            // Only samples that can contribute need a shadow ray
+            if (cosTheta > 0.0f && pdf > 0.0f) {
+                samples.push_back({ pointOnLight, (cosTheta / pdf) * emittedColor * scale });
+            }
+        };
+
+        if (!lightBvh_.empty()) {
+            for (int currentSample = 0; currentSample < sampleCount; ++currentSample) {
+                // a single light needs no choice and keeps its random sequence
+                float pmf = 1.0f;
+                int light = 0;
+                if (lights_.size() > 1) {
+                    light = lightBvh_.sample(hit.p, hit.n, sampler.next1D(), pmf);
+                    if (light < 0) {
+                        continue;
+                    }
                 }
+                sampleLight(*lights_[light], 1.0f / (pmf * static_cast<float>(sampleCount)));
+            }
+            return;
+        }
 
-                ++currentSample;
+        for (auto& lightSource : lights_) {
+            for (int currentSample = 0; currentSample < sampleCount; ++currentSample) {
+                sampleLight(*lightSource, 1.0f / static_cast<float>(sampleCount));
             }
         }
-        lightResult /= static_cast<float>(sampleCount);
-        return lightResult;
     }
 
+    glm::vec3 Scene::sampleDirectLight(ne::Ray& ray, ne::Intersection& hit, ne::Sampler& sampler) const {
+        // scratch buffer reused by every call on this thread
+        thread_local std::vector<ne::LightSample> samples;
+        samples.clear();
+        sampleLights(hit, sampler, samples);
+
+        glm::vec3 lightResult(0.0f);
+        for (const auto& sample : samples) {
+            if (!occluded(hit.p, sample.target)) {
+                lightResult += sample.weight;
+            }
+        }
+        return lightResult;
+    }
 
 } // namespace ne
@@ -2,26 +2,150 @@
 #define __SCENE_H_
 
 #include "neon/blueprint.hpp"
+#include "neon/bvh.hpp"
+#include "neon/bvh8.hpp"
 #include "neon/intersection.hpp"
+#include "neon/lightbvh.hpp"
 #include "neon/rendable.hpp"
+#include "neon/spherepack.hpp"
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace ne {
 
+// Candidate shadow ray of direct light sampling: the point on a light and its
+// contribution if nothing blocks the segment towards it.
+struct LightSample {
+  glm::vec3 target;
+  glm::vec3 weight;
+};
+
 class Scene {
 
 public:
   void add(RendablePointer object);
+  /// Flat table of every material used by the scene. Hits point into it.
+  const std::vector<ne::MaterialPointer> &materials() const {
+    return materials_;
+  }
+  /// Finalize the scene: pack spheres for the SIMD kernels and build the BVHs.
+  /// Must be called again after add(), otherwise rayIntersect falls back to a
+  /// linear scan.
+  void build();
+  /// SAH cost of the current BVHs, 0 when the scene is not built
+  float sahCost() const { return sphereBvh_.sahCost() + bvh_.sahCost(); }
+  /// Trace single rays through 8 wide BVHs with quantized bounds (see
+  /// ne::BVH8) instead of the binary ones. Takes effect at the next build().
+  void setWideBvh(bool wide) {
+    wide_ = wide;
+    built_ = false;
+  }
+  /// Split method and worker threads of the BVH builds. Takes effect at the
+  /// next build().
+  void setBvhBuilder(ne::BvhBuilder builder, unsigned numThreads = 1) {
+    builder_ = builder;
+    buildThreads_ = numThreads;
+    built_ = false;
+  }
+  /// Animation: move a sphere to a new center, or an instance so that its
+  /// origin lands on position. Returns false for objects that are not part
+  /// of the built scene or can not move. Call update() before rendering.
+  bool setPosition(const RendablePointer &object, const glm::vec3 &position);
+  /// Animation: new object to world transform of an instance. Spheres take
+  /// only its translation.
+  bool setTransform(const RendablePointer &object, const glm::mat4 &toWorld);
+  /// Apply the moves since the last update() or build(): refit the BVHs
+  /// bottom up over the changed objects only, or rebuild when the SAH cost
+  /// has grown by more than the rebuild threshold since the last build.
+  /// Returns true when it rebuilt. Must not run while rays are traced.
+  bool update();
+  /// relative SAH cost growth that triggers a rebuild, e.g. 0.3 for 30%
+  void setRebuildThreshold(float threshold) { rebuildThreshold_ = threshold; }
+  /// With the light BVH (default) every shading point draws
+  /// lightSampleCount_ samples from lights picked by importance, so the cost
+  /// does not grow with the number of lights. Without it every light gets
+  /// lightSampleCount_ samples. Takes effect at the next build().
+  void setLightBvh(bool enabled) {
+    lightBvhEnabled_ = enabled;
+    built_ = false;
+  }
+  /// true when build() produced the wide BVHs single rays traverse
+  bool wideBvh() const { return traverseWide_; }
+  /// bytes of BVH nodes traversed by single rays
+  size_t bvhMemory() const;
+  /// packed spheres, valid after build()
+  ne::SpherePack &spheres() { return spheres_; }
   glm::vec3 background(ne::Ray &ray);
   bool rayIntersect(ne::Ray &ray, ne::Intersection &hit) const; 
-  glm::vec3 sampleDirectLight(ne::Ray &ray, ne::Intersection &hit) const;
+  /// Closest hits of a packet of coherent rays, hits[i] belongs to
+  /// packet.rays[i]. Same results as rayIntersect per ray. Returns the lanes
+  /// that hit something.
+  uint32_t rayIntersect(ne::RayPacket &packet, ne::Intersection *hits) const;
+  /// Shadow ray query. True when any object blocks the open segment between
+  /// origin and target. Stops at the first blocker and fills no Intersection.
+  bool occluded(const glm::vec3 &origin, const glm::vec3 &target) const;
+  glm::vec3 sampleDirectLight(ne::Ray &ray, ne::Intersection &hit,
+                              ne::Sampler &sampler) const;
+  /// First half of sampleDirectLight: appends one LightSample per light sample
+  /// facing the hit point, without testing occlusion. Lets the wavefront
+  /// integrator trace all shadow rays of a batch in a separate stage.
+  void sampleLights(const ne::Intersection &hit, ne::Sampler &sampler,
+                    std::vector<ne::LightSample> &samples) const;
+  /// index of a material in materials(), or materials().size() for one add()
+  /// never saw, e.g. of a child added to a Group after the group was added
+  uint32_t materialIndex(const ne::abstract::Material *m) const {
+    const auto it = materialIndex_.find(m);
+    if (it == materialIndex_.end())
+      return static_cast<uint32_t>(materials_.size());
+    return it->second;
+  }
   glm::vec3 sampleBackgroundLight(const glm::vec3 &dir) const;
 
 private:
   std::vector<ne::RendablePointer> objects_;
   std::vector<ne::RendablePointer> lights_;
+  std::vector<ne::MaterialPointer> materials_;
+  std::unordered_map<const ne::abstract::Material *, uint32_t> materialIndex_;
+  bool built_ = false;
+  bool wide_ = false;         // requested by setWideBvh
+  bool traverseWide_ = false; // wide BVHs were built
+  // collapse the binary BVHs into the wide ones if wide_ is set, before
+  // spheres_ and primitives_ are put in leaf order
+  void buildWide();
+  // position of every built object in spheres_ or primitives_, flagged
+  std::unordered_map<const ne::abstract::Rendable *, uint32_t> slots_;
+  inline static constexpr uint32_t sphereSlot_ = 0x80000000u;
+  std::vector<uint32_t> movedSpheres_, movedPrimitives_;
+  float builtSahCost_[2] = {}; // spheres, primitives
+  float rebuildThreshold_ = 0.3f;
+
+  // importance sampling of lights_, indices refer to lights_
+  void buildLightBvh();
+  ne::LightBVH lightBvh_;
+  bool lightBvhEnabled_ = true;
+  bool lightsMoved_ = false;
+  ne::BvhBuilder builder_ = ne::BvhBuilder::BinnedSah;
+  unsigned buildThreads_ = 1;
+
+  // spheres in SoA layout with their own BVH, leaves are contiguous ranges
+  ne::SpherePack spheres_;
+  ne::BVH sphereBvh_;
+  ne::BVH8 sphereBvh8_;
+
+  // all other rendables, in BVH leaf order
+  std::vector<ne::RendablePointer> primitives_;
+  ne::BVH bvh_;
+  ne::BVH8 bvh8_;
+
+  /// Part of a shadow segment ignored at the target end, so that the surface
+  /// being sampled does not occlude itself.
+  inline static constexpr float shadowEps_ = 0.001f;
+  /// shadow samples per light and shading point. Cone sampling never wastes
+  /// one on the back of a light; 4 keep penumbrae as smooth as 10 uniform
+  /// surface samples did.
+  inline static constexpr int lightSampleCount_ = 4;
 };
 
 } // namespace ne
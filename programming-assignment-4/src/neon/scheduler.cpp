@@ -0,0 +1,299 @@
+#include "neon/scheduler.hpp"
+#include "neon/trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+namespace ne {
+
+uint64_t mortonIndex(uint32_t x, uint32_t y) {
+  auto spread = [](uint64_t v) {
+    v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+    v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+    v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+  };
+  return spread(x) | (spread(y) << 1);
+}
+
+uint64_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y) {
+  uint64_t d = 0;
+  for (uint32_t s = n / 2; s > 0; s /= 2) {
+    const uint32_t rx = (x & s) > 0;
+    const uint32_t ry = (y & s) > 0;
+    d += uint64_t(s) * s * ((3 * rx) ^ ry);
+    // rotate the quadrant so the curve stays continuous
+    if (ry == 0) {
+      if (rx == 1) {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+std::vector<uint32_t> orderTiles(const std::vector<ne::TileIterator> &tiles,
+                                 TileOrder order) {
+  std::vector<uint32_t> result(tiles.size());
+  std::iota(result.begin(), result.end(), 0u);
+  if (tiles.empty() || order == TileOrder::Scanline)
+    return result;
+
+  // position of every tile in the tile grid
+  const glm::uvec2 tileSize = glm::max(
+      tiles[0].endIndex() - tiles[0].startIndex(), glm::uvec2(1));
+  std::vector<glm::uvec2> cells(tiles.size());
+  glm::uvec2 gridSize(1);
+  for (size_t t = 0; t < tiles.size(); ++t) {
+    cells[t] = tiles[t].startIndex() / tileSize;
+    gridSize = glm::max(gridSize, cells[t] + 1u);
+  }
+  uint32_t n = 1;
+  while (n < gridSize.x || n < gridSize.y)
+    n *= 2;
+
+  std::vector<uint64_t> keys(tiles.size());
+  for (size_t t = 0; t < tiles.size(); ++t)
+    keys[t] = order == TileOrder::Morton
+                  ? mortonIndex(cells[t].x, cells[t].y)
+                  : hilbertIndex(n, cells[t].x, cells[t].y);
+  std::sort(result.begin(), result.end(),
+            [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+  return result;
+}
+
+TileScheduler::TileScheduler(const std::vector<ne::TileIterator> &tiles,
+                             unsigned int numWorkers, TileOrder order,
+                             unsigned int minTileSize)
+    : tiles_(tiles), order_(orderTiles(tiles, order)),
+      numWorkers_(std::max(numWorkers, 1u)),
+      minTileSize_(std::max(minTileSize, 1u)),
+      remaining_(new std::atomic<uint32_t>[tiles.size()]),
+      tileTime_(new std::atomic<uint64_t>[tiles.size()]),
+      statistics_(numWorkers_) {
+  for (size_t t = 0; t < tiles_.size(); ++t)
+    tileTime_[t] = 0;
+  for (unsigned int w = 0; w < numWorkers_; ++w)
+    queues_.emplace_back(new Queue());
+}
+
+void TileScheduler::reset() {
+  // deal the curve in contiguous runs, one per worker
+  const size_t n = order_.size();
+  for (unsigned int w = 0; w < numWorkers_; ++w) {
+    std::lock_guard<std::mutex> lock(queues_[w]->mutex);
+    queues_[w]->tiles.clear();
+    for (size_t i = w * n / numWorkers_; i < (w + 1) * n / numWorkers_; ++i)
+      queues_[w]->tiles.push_back({tiles_[order_[i]], order_[i]});
+  }
+  for (size_t t = 0; t < tiles_.size(); ++t)
+    remaining_[t] = tiles_[t].numPixels();
+  pending_ = static_cast<int64_t>(n);
+  queued_ = static_cast<int64_t>(n);
+  idle_ = 0;
+
+  for (WorkerStatistics &s : statistics_)
+    s.passBusy = 0.0;
+  passStart_ = Clock::now();
+}
+
+void TileScheduler::work(
+    unsigned int worker,
+    const std::function<void(const ScheduledTile &)> &render) {
+  ne::trace::Scope span("worker", "scheduler");
+  span.arg("worker", worker);
+  ScheduledTile tile;
+  bool stolen = false;
+  while (pop(worker, tile, stolen)) {
+    const Clock::time_point start = Clock::now();
+    {
+      ne::trace::Scope piece(stolen ? "stolen tile" : "tile", "render");
+      piece.arg("tile", tile.tile)
+          .arg("x", tile.pixels.startIndex().x)
+          .arg("y", tile.pixels.startIndex().y);
+      render(tile);
+    }
+    const Clock::duration time = Clock::now() - start;
+    const double seconds = std::chrono::duration<double>(time).count();
+    tileTime_[tile.tile].fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(),
+        std::memory_order_relaxed);
+    statistics_[worker].busy += seconds;
+    statistics_[worker].passBusy += seconds;
+    ++statistics_[worker].tiles;
+  }
+}
+
+bool TileScheduler::complete(const ScheduledTile &piece) {
+  const uint32_t numPixels = piece.pixels.numPixels();
+  return remaining_[piece.tile].fetch_sub(numPixels,
+                                          std::memory_order_acq_rel) ==
+         numPixels;
+}
+
+void TileScheduler::finish() {
+  const double wall =
+      std::chrono::duration<double>(Clock::now() - passStart_).count();
+  wall_ += wall;
+  for (WorkerStatistics &s : statistics_)
+    s.idle += std::max(0.0, wall - s.passBusy);
+}
+
+bool TileScheduler::pop(unsigned int worker, ScheduledTile &tile,
+                        bool &stolen) {
+  stolen = false;
+  while (pending_.load(std::memory_order_acquire) > 0) {
+    bool found = false;
+    // whether the queues ran empty with this tile, counted under the lock
+    // so waiting workers never see a tile that is already gone
+    bool last = false;
+    {
+      Queue &own = *queues_[worker];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tiles.empty()) {
+        tile = own.tiles.front();
+        own.tiles.pop_front();
+        found = true;
+        last = queued_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+      }
+    }
+    for (unsigned int i = 1; i < numWorkers_ && !found; ++i) {
+      Queue &victim = *queues_[(worker + i) % numWorkers_];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tiles.empty()) {
+        tile = victim.tiles.back();
+        victim.tiles.pop_back();
+        found = true;
+        stolen = true;
+        last = queued_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        ++statistics_[worker].steals;
+      }
+    }
+
+    if (!found) {
+      // another worker took the last tile and may still split it
+      std::unique_lock<std::mutex> lock(idleMutex_);
+      ++idle_;
+      wakeup_.wait(lock, [this] {
+        return pending_.load(std::memory_order_acquire) == 0 ||
+               queued_.load(std::memory_order_acquire) > 0;
+      });
+      --idle_;
+      continue;
+    }
+
+    // split only for workers that ran dry or are about to
+    const bool starving =
+        numWorkers_ > 1 && (last || idle_.load(std::memory_order_relaxed) > 0);
+    std::vector<ScheduledTile> pieces;
+    if (starving && split(tile, pieces)) {
+      tile = pieces[0];
+      pending_ += static_cast<int64_t>(pieces.size() - 1);
+      {
+        Queue &own = *queues_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.tiles.insert(own.tiles.begin(), pieces.begin() + 1, pieces.end());
+        queued_ += static_cast<int64_t>(pieces.size() - 1);
+      }
+      ++statistics_[worker].splits;
+      notify();
+    }
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      notify();
+    return true;
+  }
+  return false;
+}
+
+void TileScheduler::notify() {
+  std::lock_guard<std::mutex> lock(idleMutex_);
+  wakeup_.notify_all();
+}
+
+bool TileScheduler::split(const ScheduledTile &tile,
+                          std::vector<ScheduledTile> &pieces) const {
+  const glm::uvec2 start = tile.pixels.startIndex();
+  const glm::uvec2 end = tile.pixels.endIndex();
+  const glm::uvec2 size = end - start;
+  const bool splitX = size.x >= 2 * minTileSize_;
+  const bool splitY = size.y >= 2 * minTileSize_;
+  if (!splitX && !splitY)
+    return false;
+
+  const glm::uvec2 mid(splitX ? start.x + size.x / 2 : end.x,
+                       splitY ? start.y + size.y / 2 : end.y);
+  const uint32_t xs[3] = {start.x, mid.x, end.x};
+  const uint32_t ys[3] = {start.y, mid.y, end.y};
+  for (int j = 0; j < 2; ++j) {
+    for (int i = 0; i < 2; ++i) {
+      const glm::uvec2 s(xs[i], ys[j]), e(xs[i + 1], ys[j + 1]);
+      if (s.x < e.x && s.y < e.y)
+        pieces.push_back({ne::TileIterator(s, e), tile.tile});
+    }
+  }
+  return true;
+}
+
+void TileScheduler::report(std::ostream &out) const {
+  char line[128];
+  std::snprintf(line, sizeof(line), "%6s %9s %9s %7s %8s %7s %7s\n", "worker",
+                "busy[s]", "idle[s]", "idle", "tiles", "steals", "splits");
+  out << line;
+  for (unsigned int w = 0; w < numWorkers_; ++w) {
+    const WorkerStatistics &s = statistics_[w];
+    std::snprintf(line, sizeof(line),
+                  "%6u %9.3f %9.3f %6.1f%% %8llu %7llu %7llu\n", w, s.busy,
+                  s.idle, wall_ > 0.0 ? 100.0 * s.idle / wall_ : 0.0,
+                  (unsigned long long)s.tiles, (unsigned long long)s.steals,
+                  (unsigned long long)s.splits);
+    out << line;
+  }
+}
+
+std::vector<double> TileScheduler::tileSeconds() const {
+  std::vector<double> seconds(tiles_.size());
+  for (size_t t = 0; t < tiles_.size(); ++t)
+    seconds[t] = tileTime_[t].load(std::memory_order_relaxed) * 1e-9;
+  return seconds;
+}
+
+void TileScheduler::reportTiles(std::ostream &out, size_t numTiles) const {
+  const std::vector<double> seconds = tileSeconds();
+  if (seconds.empty())
+    return;
+  const auto minmax = std::minmax_element(seconds.begin(), seconds.end());
+  const double total = std::accumulate(seconds.begin(), seconds.end(), 0.0);
+
+  char line[128];
+  std::snprintf(line, sizeof(line),
+                "tile time: min %.2f ms, mean %.2f ms, max %.2f ms\n",
+                *minmax.first * 1e3, total / seconds.size() * 1e3,
+                *minmax.second * 1e3);
+  out << line;
+
+  std::vector<uint32_t> order(seconds.size());
+  std::iota(order.begin(), order.end(), 0u);
+  numTiles = std::min(numTiles, order.size());
+  std::partial_sort(order.begin(), order.begin() + numTiles, order.end(),
+                    [&](uint32_t a, uint32_t b) {
+                      return seconds[a] > seconds[b];
+                    });
+  std::snprintf(line, sizeof(line), "%6s %12s %10s %7s\n", "tile", "start",
+                "time[ms]", "share");
+  out << line;
+  for (size_t i = 0; i < numTiles; ++i) {
+    const uint32_t t = order[i];
+    std::snprintf(line, sizeof(line), "%6u %5u, %5u %10.2f %6.1f%%\n", t,
+                  tiles_[t].startIndex().x, tiles_[t].startIndex().y,
+                  seconds[t] * 1e3,
+                  total > 0.0 ? 100.0 * seconds[t] / total : 0.0);
+    out << line;
+  }
+}
+
+} // namespace ne
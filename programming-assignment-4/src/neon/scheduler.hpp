@@ -0,0 +1,136 @@
+#ifndef __SCHEDULER_H_
+#define __SCHEDULER_H_
+
+#include "neon/image.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace ne {
+
+enum class TileOrder { Scanline, Morton, Hilbert };
+
+/// index of cell (x, y) along a Morton (Z order) curve
+uint64_t mortonIndex(uint32_t x, uint32_t y);
+/// index of cell (x, y) along a Hilbert curve covering a n x n grid,
+/// n is a power of two
+uint64_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y);
+
+/// tile indices sorted along the given curve over the tile grid
+std::vector<uint32_t> orderTiles(const std::vector<ne::TileIterator> &tiles,
+                                 TileOrder order);
+
+// Part of one of the scheduler's tiles, handed to a worker.
+struct ScheduledTile {
+  ne::TileIterator pixels;
+  uint32_t tile; // index of the tile it was cut from
+};
+
+// Work stealing tile scheduler. Every pass the tiles are sorted along a space
+// filling curve and dealt to the workers in contiguous runs, so neighbouring
+// tiles (and the scene data they touch) stay on one worker. A worker takes
+// tiles from the front of its own queue and, once that is empty, steals from
+// the back of the others.
+//
+// Tiles are only cut up on demand: once a worker found nothing to take and
+// waits, or the last queued tile was just taken, a worker that takes a tile
+// larger than minTileSize renders only its first quarter and puts the other
+// three at the front of its queue, where the waiting workers steal them. A
+// few expensive tiles at the end of a pass so do not leave the other workers
+// idle, while a pass with enough tiles for everyone keeps them whole and in
+// curve order. Waiting workers sleep until tiles are queued or the pass ends.
+//
+// Run one work() call per worker in parallel between reset() and finish().
+class TileScheduler {
+public:
+  TileScheduler(const std::vector<ne::TileIterator> &tiles,
+                unsigned int numWorkers, TileOrder order = TileOrder::Hilbert,
+                unsigned int minTileSize = 8);
+
+  /// queue all tiles for a new pass
+  void reset();
+
+  /// render tiles on worker `worker` until none are left
+  void work(unsigned int worker,
+            const std::function<void(const ScheduledTile &)> &render);
+
+  /// Mark a piece as rendered. Returns true once all pieces of its tile are,
+  /// which makes the whole tile safe to read.
+  bool complete(const ScheduledTile &piece);
+
+  /// end the pass and account the time workers waited for it to finish
+  void finish();
+
+  /// per worker busy and idle time, tiles, steals and splits
+  void report(std::ostream &out) const;
+
+  /// wall time spent rendering each tile, summed over its pieces and passes
+  std::vector<double> tileSeconds() const;
+
+  /// min, mean and max tile time and the slowest tiles
+  void reportTiles(std::ostream &out, size_t numTiles = 5) const;
+
+  unsigned int numWorkers() const { return numWorkers_; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<ScheduledTile> tiles;
+  };
+
+  struct WorkerStatistics {
+    double busy = 0.0;     // seconds spent rendering in all passes
+    double passBusy = 0.0; // seconds spent rendering in this pass
+    double idle = 0.0;     // seconds waiting for other workers
+    uint64_t tiles = 0;
+    uint64_t steals = 0;
+    uint64_t splits = 0;
+  };
+
+  // stolen tells whether the tile came from another worker's queue
+  bool pop(unsigned int worker, ScheduledTile &tile, bool &stolen);
+  bool split(const ScheduledTile &tile,
+             std::vector<ScheduledTile> &pieces) const;
+
+  std::vector<ne::TileIterator> tiles_;
+  std::vector<uint32_t> order_;
+  unsigned int numWorkers_;
+  unsigned int minTileSize_;
+
+  // wake waiting workers after tiles were queued or the pass ran out
+  void notify();
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  // queued tiles plus tiles taken but not yet considered for splitting, a
+  // worker only leaves once this reaches zero
+  std::atomic<int64_t> pending_{0};
+  // tiles in all queues
+  std::atomic<int64_t> queued_{0};
+  // workers that found every queue empty and wait, splitting starts when
+  // one does
+  std::atomic<int> idle_{0};
+  std::mutex idleMutex_;
+  std::condition_variable wakeup_;
+  // pixels of each tile still to render in this pass
+  std::unique_ptr<std::atomic<uint32_t>[]> remaining_;
+  // nanoseconds spent on each tile, added once per piece
+  std::unique_ptr<std::atomic<uint64_t>[]> tileTime_;
+
+  std::vector<WorkerStatistics> statistics_;
+  Clock::time_point passStart_;
+  double wall_ = 0.0;
+};
+
+} // namespace ne
+
+#endif // __SCHEDULER_H_
@@ -21,13 +21,30 @@ bool Sphere::rayIntersect(ne::Ray &ray, Intersection &hit) {
     return false;
 
   const float t = t0 > eps_ ? t0 : t1;
+  // keep closest hit, t1 may lie behind a hit found earlier
+  if (t > ray.t)
+    return false;
   ray.t = t;
   hit.p = ray.at(t);
   hit.n = (hit.p - center_) / radius_;
-  hit.material = material_;
+  hit.material = material_.get();
 
   return true;
 }
 
+bool Sphere::occluded(const ne::Ray &ray) {
+  const float r2 = radius_ * radius_;
+  glm::vec3 diff = center_ - ray.o;
+  float c0 = glm::dot(diff, ray.dir);
+  float d2 = glm::dot(diff, diff) - c0 * c0;
+  if (d2 > r2)
+    return false;
+  float c1 = glm::sqrt(r2 - d2);
+  float t0 = c0 - c1;
+  float t1 = c0 + c1;
+
+  const float t = t0 > eps_ ? t0 : t1;
+  return t > eps_ && t < ray.t;
+}
 
 } // namespace ne
@@ -12,6 +12,11 @@ namespace ne {
           : ne::abstract::Rendable(m), center_(c), radius_(r) {}
 
       bool rayIntersect(ne::Ray & ray, Intersection & hit) override;
+      bool occluded(const ne::Ray & ray) override;
+
+      ne::AABB bounds() const override {
+        return ne::AABB(center_ - glm::vec3(radius_), center_ + glm::vec3(radius_));
+      }
 
       //glm::vec3 sample() const;  // sample ޼ҵ  ߰
 
@@ -0,0 +1,439 @@
+#include "neon/spherepack.hpp"
+#include "neon/rendable.hpp"
+#include "neon/sphere.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) ||            \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NE_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX instructions inside functions marked with a
+// target attribute, MSVC accepts the intrinsics anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define NE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define NE_TARGET(isa)
+#endif
+
+// Fused multiply-add would change the rounding of t, and every kernel has to
+// agree bit for bit with Sphere::rayIntersect.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace ne {
+
+namespace {
+
+struct Arrays {
+  const float *cx, *cy, *cz, *r;
+};
+
+constexpr float eps = ne::abstract::Rendable::eps_;
+
+// Every kernel returns the index of the closest sphere in [first, first +
+// count) whose hit distance does not exceed tHit and updates tHit, or -1. In
+// any hit mode it returns the first sphere hit inside (eps, tHit).
+using Kernel = int (*)(const Arrays &, uint32_t, uint32_t, const ne::Ray &,
+                       float &, bool);
+
+int intersectScalar(const Arrays &a, uint32_t first, uint32_t count,
+                    const ne::Ray &ray, float &tHit, bool anyHit) {
+  int best = -1;
+  for (uint32_t i = first; i < first + count; ++i) {
+    // same steps as Sphere::rayIntersect
+    const float r2 = a.r[i] * a.r[i];
+    const glm::vec3 diff = glm::vec3(a.cx[i], a.cy[i], a.cz[i]) - ray.o;
+    const float c0 = glm::dot(diff, ray.dir);
+    const float d2 = glm::dot(diff, diff) - c0 * c0;
+    if (d2 > r2)
+      continue;
+    const float c1 = glm::sqrt(r2 - d2);
+    const float t0 = c0 - c1;
+    const float t1 = c0 + c1;
+    const float t = t0 > eps ? t0 : t1;
+
+    if (anyHit) {
+      if (t > eps && t < tHit)
+        return static_cast<int>(i);
+      continue;
+    }
+
+    if (t0 > tHit || t1 < eps || t > tHit)
+      continue;
+    tHit = t;
+    best = static_cast<int>(i);
+  }
+  return best;
+}
+
+#ifdef NE_SIMD_X86
+
+inline int lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// Ties are resolved towards the later sphere, like the scalar loop does
+inline int highestBit(unsigned mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse(&index, mask);
+  return static_cast<int>(index);
+#else
+  return 31 - __builtin_clz(mask);
+#endif
+}
+
+int intersectSSE(const Arrays &a, uint32_t first, uint32_t count,
+                 const ne::Ray &ray, float &tHit, bool anyHit) {
+  const __m128 ox = _mm_set1_ps(ray.o.x);
+  const __m128 oy = _mm_set1_ps(ray.o.y);
+  const __m128 oz = _mm_set1_ps(ray.o.z);
+  const __m128 dx = _mm_set1_ps(ray.dir.x);
+  const __m128 dy = _mm_set1_ps(ray.dir.y);
+  const __m128 dz = _mm_set1_ps(ray.dir.z);
+  const __m128 veps = _mm_set1_ps(eps);
+  const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+  int best = -1;
+  const uint32_t end = first + count;
+  for (uint32_t base = first; base < end; base += 4) {
+    const __m128 vx = _mm_sub_ps(_mm_loadu_ps(a.cx + base), ox);
+    const __m128 vy = _mm_sub_ps(_mm_loadu_ps(a.cy + base), oy);
+    const __m128 vz = _mm_sub_ps(_mm_loadu_ps(a.cz + base), oz);
+    const __m128 r = _mm_loadu_ps(a.r + base);
+
+    const __m128 r2 = _mm_mul_ps(r, r);
+    const __m128 c0 = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz));
+    const __m128 dd = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+    const __m128 d2 = _mm_sub_ps(dd, _mm_mul_ps(c0, c0));
+
+    __m128 mask = _mm_and_ps(_mm_cmplt_ps(lane, _mm_set1_ps(float(end - base))),
+                             _mm_cmple_ps(d2, r2));
+    if (_mm_movemask_ps(mask) == 0)
+      continue;
+
+    const __m128 c1 = _mm_sqrt_ps(_mm_sub_ps(r2, d2));
+    const __m128 t0 = _mm_sub_ps(c0, c1);
+    const __m128 t1 = _mm_add_ps(c0, c1);
+    const __m128 useT0 = _mm_cmpgt_ps(t0, veps);
+    const __m128 t =
+        _mm_or_ps(_mm_and_ps(useT0, t0), _mm_andnot_ps(useT0, t1));
+    const __m128 tmax = _mm_set1_ps(tHit);
+
+    if (anyHit) {
+      mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, veps),
+                                         _mm_cmplt_ps(t, tmax)));
+      const int m = _mm_movemask_ps(mask);
+      if (m)
+        return static_cast<int>(base) + lowestBit(m);
+      continue;
+    }
+
+    mask = _mm_and_ps(mask, _mm_cmple_ps(t0, tmax));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(t1, veps));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(t, tmax));
+    const int m = _mm_movemask_ps(mask);
+    if (m == 0)
+      continue;
+
+    const __m128 tc = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, inf));
+    __m128 mn = _mm_min_ps(tc, _mm_shuffle_ps(tc, tc, _MM_SHUFFLE(2, 3, 0, 1)));
+    mn = _mm_min_ps(mn, _mm_shuffle_ps(mn, mn, _MM_SHUFFLE(1, 0, 3, 2)));
+    const int eq = _mm_movemask_ps(_mm_cmpeq_ps(tc, mn)) & m;
+    tHit = _mm_cvtss_f32(mn);
+    best = static_cast<int>(base) + highestBit(eq);
+  }
+  return best;
+}
+
+NE_TARGET("avx2")
+int intersectAVX2(const Arrays &a, uint32_t first, uint32_t count,
+                  const ne::Ray &ray, float &tHit, bool anyHit) {
+  const __m256 ox = _mm256_set1_ps(ray.o.x);
+  const __m256 oy = _mm256_set1_ps(ray.o.y);
+  const __m256 oz = _mm256_set1_ps(ray.o.z);
+  const __m256 dx = _mm256_set1_ps(ray.dir.x);
+  const __m256 dy = _mm256_set1_ps(ray.dir.y);
+  const __m256 dz = _mm256_set1_ps(ray.dir.z);
+  const __m256 veps = _mm256_set1_ps(eps);
+  const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 lane =
+      _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+  int best = -1;
+  const uint32_t end = first + count;
+  for (uint32_t base = first; base < end; base += 8) {
+    const __m256 vx = _mm256_sub_ps(_mm256_loadu_ps(a.cx + base), ox);
+    const __m256 vy = _mm256_sub_ps(_mm256_loadu_ps(a.cy + base), oy);
+    const __m256 vz = _mm256_sub_ps(_mm256_loadu_ps(a.cz + base), oz);
+    const __m256 r = _mm256_loadu_ps(a.r + base);
+
+    const __m256 r2 = _mm256_mul_ps(r, r);
+    const __m256 c0 = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(vx, dx), _mm256_mul_ps(vy, dy)),
+        _mm256_mul_ps(vz, dz));
+    const __m256 dd = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)),
+        _mm256_mul_ps(vz, vz));
+    const __m256 d2 = _mm256_sub_ps(dd, _mm256_mul_ps(c0, c0));
+
+    __m256 mask = _mm256_and_ps(
+        _mm256_cmp_ps(lane, _mm256_set1_ps(float(end - base)), _CMP_LT_OQ),
+        _mm256_cmp_ps(d2, r2, _CMP_LE_OQ));
+    if (_mm256_movemask_ps(mask) == 0)
+      continue;
+
+    const __m256 c1 = _mm256_sqrt_ps(_mm256_sub_ps(r2, d2));
+    const __m256 t0 = _mm256_sub_ps(c0, c1);
+    const __m256 t1 = _mm256_add_ps(c0, c1);
+    const __m256 t =
+        _mm256_blendv_ps(t1, t0, _mm256_cmp_ps(t0, veps, _CMP_GT_OQ));
+    const __m256 tmax = _mm256_set1_ps(tHit);
+
+    if (anyHit) {
+      mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, veps, _CMP_GT_OQ));
+      mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, tmax, _CMP_LT_OQ));
+      const int m = _mm256_movemask_ps(mask);
+      if (m)
+        return static_cast<int>(base) + lowestBit(m);
+      continue;
+    }
+
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(t0, tmax, _CMP_LE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(t1, veps, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, tmax, _CMP_LE_OQ));
+    const int m = _mm256_movemask_ps(mask);
+    if (m == 0)
+      continue;
+
+    const __m256 tc = _mm256_blendv_ps(inf, t, mask);
+    __m256 mn = _mm256_min_ps(tc, _mm256_permute2f128_ps(tc, tc, 0x01));
+    mn = _mm256_min_ps(mn, _mm256_shuffle_ps(mn, mn, _MM_SHUFFLE(2, 3, 0, 1)));
+    mn = _mm256_min_ps(mn, _mm256_shuffle_ps(mn, mn, _MM_SHUFFLE(1, 0, 3, 2)));
+    const int eq = _mm256_movemask_ps(_mm256_cmp_ps(tc, mn, _CMP_EQ_OQ)) & m;
+    tHit = _mm256_cvtss_f32(mn);
+    best = static_cast<int>(base) + highestBit(eq);
+  }
+  return best;
+}
+
+NE_TARGET("avx512f")
+int intersectAVX512(const Arrays &a, uint32_t first, uint32_t count,
+                    const ne::Ray &ray, float &tHit, bool anyHit) {
+  const __m512 ox = _mm512_set1_ps(ray.o.x);
+  const __m512 oy = _mm512_set1_ps(ray.o.y);
+  const __m512 oz = _mm512_set1_ps(ray.o.z);
+  const __m512 dx = _mm512_set1_ps(ray.dir.x);
+  const __m512 dy = _mm512_set1_ps(ray.dir.y);
+  const __m512 dz = _mm512_set1_ps(ray.dir.z);
+  const __m512 veps = _mm512_set1_ps(eps);
+  const __m512 inf = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+
+  int best = -1;
+  const uint32_t end = first + count;
+  for (uint32_t base = first; base < end; base += 16) {
+    const uint32_t n = end - base;
+    const __mmask16 valid =
+        n >= 16 ? __mmask16(0xffff) : __mmask16((1u << n) - 1u);
+
+    const __m512 vx = _mm512_sub_ps(_mm512_loadu_ps(a.cx + base), ox);
+    const __m512 vy = _mm512_sub_ps(_mm512_loadu_ps(a.cy + base), oy);
+    const __m512 vz = _mm512_sub_ps(_mm512_loadu_ps(a.cz + base), oz);
+    const __m512 r = _mm512_loadu_ps(a.r + base);
+
+    const __m512 r2 = _mm512_mul_ps(r, r);
+    const __m512 c0 = _mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(vx, dx), _mm512_mul_ps(vy, dy)),
+        _mm512_mul_ps(vz, dz));
+    const __m512 dd = _mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(vx, vx), _mm512_mul_ps(vy, vy)),
+        _mm512_mul_ps(vz, vz));
+    const __m512 d2 = _mm512_sub_ps(dd, _mm512_mul_ps(c0, c0));
+
+    __mmask16 mask = _mm512_mask_cmp_ps_mask(valid, d2, r2, _CMP_LE_OQ);
+    if (mask == 0)
+      continue;
+
+    const __m512 c1 = _mm512_sqrt_ps(_mm512_sub_ps(r2, d2));
+    const __m512 t0 = _mm512_sub_ps(c0, c1);
+    const __m512 t1 = _mm512_add_ps(c0, c1);
+    const __m512 t =
+        _mm512_mask_blend_ps(_mm512_cmp_ps_mask(t0, veps, _CMP_GT_OQ), t1, t0);
+    const __m512 tmax = _mm512_set1_ps(tHit);
+
+    if (anyHit) {
+      mask = _mm512_mask_cmp_ps_mask(mask, t, veps, _CMP_GT_OQ);
+      mask = _mm512_mask_cmp_ps_mask(mask, t, tmax, _CMP_LT_OQ);
+      if (mask)
+        return static_cast<int>(base) + lowestBit(mask);
+      continue;
+    }
+
+    mask = _mm512_mask_cmp_ps_mask(mask, t0, tmax, _CMP_LE_OQ);
+    mask = _mm512_mask_cmp_ps_mask(mask, t1, veps, _CMP_GE_OQ);
+    mask = _mm512_mask_cmp_ps_mask(mask, t, tmax, _CMP_LE_OQ);
+    if (mask == 0)
+      continue;
+
+    const __m512 tc = _mm512_mask_blend_ps(mask, inf, t);
+    const float mn = _mm512_reduce_min_ps(tc);
+    const unsigned eq =
+        _mm512_mask_cmp_ps_mask(mask, tc, _mm512_set1_ps(mn), _CMP_EQ_OQ);
+    tHit = mn;
+    best = static_cast<int>(base) + highestBit(eq);
+  }
+  return best;
+}
+
+#endif // NE_SIMD_X86
+
+Kernel kernelFor(SpherePack::Simd simd) {
+  switch (simd) {
+#ifdef NE_SIMD_X86
+  case SpherePack::Simd::AVX512:
+    return intersectAVX512;
+  case SpherePack::Simd::AVX2:
+    return intersectAVX2;
+  case SpherePack::Simd::SSE:
+    return intersectSSE;
+#endif
+  default:
+    return intersectScalar;
+  }
+}
+
+} // namespace
+
+SpherePack::Simd SpherePack::detect() {
+  static const Simd simd = []() {
+#if defined(NE_SIMD_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    // the OS has to save the wide registers on context switches
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool avx2 = false, avx512 = false;
+    if (maxLeaf >= 7) {
+      __cpuidex(info, 7, 0);
+      avx2 = avx && (info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+      avx512 = (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+    }
+    if (avx512)
+      return Simd::AVX512;
+    if (avx2)
+      return Simd::AVX2;
+    return Simd::SSE;
+#elif defined(NE_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      return Simd::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+      return Simd::AVX2;
+    return Simd::SSE;
+#else
+    return Simd::Scalar;
+#endif
+  }();
+  return simd;
+}
+
+void SpherePack::setSimd(Simd simd) {
+  simd_ = static_cast<int>(simd) <= static_cast<int>(detect()) ? simd
+                                                               : detect();
+}
+
+void SpherePack::add(const ne::Sphere &sphere) {
+  cx_.resize(count_);
+  cy_.resize(count_);
+  cz_.resize(count_);
+  radius_.resize(count_);
+
+  cx_.push_back(sphere.center_.x);
+  cy_.push_back(sphere.center_.y);
+  cz_.push_back(sphere.center_.z);
+  radius_.push_back(sphere.radius_);
+  materials_.push_back(sphere.material_.get());
+  ++count_;
+  pad();
+}
+
+void SpherePack::clear() {
+  cx_.clear();
+  cy_.clear();
+  cz_.clear();
+  radius_.clear();
+  materials_.clear();
+  count_ = 0;
+}
+
+void SpherePack::pad() {
+  cx_.resize(count_ + padding_, 0.0f);
+  cy_.resize(count_ + padding_, 0.0f);
+  cz_.resize(count_ + padding_, 0.0f);
+  radius_.resize(count_ + padding_, 0.0f);
+}
+
+void SpherePack::permute(const std::vector<uint32_t> &order) {
+  auto apply = [&](auto &v) {
+    auto copy = v;
+    for (uint32_t i = 0; i < count_; ++i)
+      v[i] = copy[order[i]];
+  };
+  apply(cx_);
+  apply(cy_);
+  apply(cz_);
+  apply(radius_);
+  apply(materials_);
+}
+
+void SpherePack::update(uint32_t i, const ne::Sphere &sphere) {
+  cx_[i] = sphere.center_.x;
+  cy_[i] = sphere.center_.y;
+  cz_[i] = sphere.center_.z;
+  radius_[i] = sphere.radius_;
+}
+
+bool SpherePack::rayIntersect(uint32_t first, uint32_t count, ne::Ray &ray,
+                              ne::Intersection &hit) const {
+  const Arrays a{cx_.data(), cy_.data(), cz_.data(), radius_.data()};
+  float t = ray.t;
+  const int i = kernelFor(simd_)(a, first, count, ray, t, false);
+  if (i < 0)
+    return false;
+
+  // same as Sphere::rayIntersect
+  ray.t = t;
+  hit.p = ray.at(t);
+  hit.n = (hit.p - center(i)) / radius_[i];
+  hit.material = materials_[i];
+  return true;
+}
+
+bool SpherePack::occluded(uint32_t first, uint32_t count,
+                          const ne::Ray &ray) const {
+  const Arrays a{cx_.data(), cy_.data(), cz_.data(), radius_.data()};
+  float t = ray.t;
+  return kernelFor(simd_)(a, first, count, ray, t, true) >= 0;
+}
+
+} // namespace ne
@@ -0,0 +1,73 @@
+#ifndef __SPHEREPACK_H_
+#define __SPHEREPACK_H_
+
+#include "neon/aabb.hpp"
+#include "neon/blueprint.hpp"
+#include "neon/intersection.hpp"
+#include "neon/ray.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace ne {
+
+// Spheres stored as structure of arrays so that one ray can be tested against
+// 4 (SSE), 8 (AVX2) or 16 (AVX-512) spheres at once. The kernel is chosen at
+// runtime from CPUID; every kernel reproduces Sphere::rayIntersect exactly,
+// including the eps_ self-intersection rule.
+class SpherePack {
+public:
+  enum class Simd { Scalar = 1, SSE = 4, AVX2 = 8, AVX512 = 16 };
+
+  /// widest kernel supported by this CPU
+  static Simd detect();
+
+  SpherePack() : simd_(detect()) {}
+
+  void add(const ne::Sphere &sphere);
+  void clear();
+  /// reorder spheres, sphere i becomes order[i]
+  void permute(const std::vector<uint32_t> &order);
+  /// copy center and radius of a moved sphere into slot i
+  void update(uint32_t i, const ne::Sphere &sphere);
+
+  uint32_t size() const { return count_; }
+  bool empty() const { return count_ == 0; }
+  /// number of spheres one kernel call tests at once
+  uint32_t width() const { return static_cast<uint32_t>(simd_); }
+
+  Simd simd() const { return simd_; }
+  /// force a kernel, e.g. for benchmarks. Clamped to what the CPU supports.
+  void setSimd(Simd simd);
+
+  glm::vec3 center(uint32_t i) const { return {cx_[i], cy_[i], cz_[i]}; }
+  float radius(uint32_t i) const { return radius_[i]; }
+  ne::AABB bounds(uint32_t i) const {
+    return ne::AABB(center(i) - glm::vec3(radius_[i]),
+                    center(i) + glm::vec3(radius_[i]));
+  }
+
+  /// closest hit among spheres [first, first + count). Shrinks ray.t and
+  /// fills hit like Sphere::rayIntersect.
+  bool rayIntersect(uint32_t first, uint32_t count, ne::Ray &ray,
+                    ne::Intersection &hit) const;
+
+  /// any hit among spheres [first, first + count) inside [eps, ray.t)
+  bool occluded(uint32_t first, uint32_t count, const ne::Ray &ray) const;
+
+private:
+  void pad();
+
+  // arrays hold padding_ extra zero entries so kernels may load a full
+  // register past the last sphere; those lanes are masked off
+  std::vector<float> cx_, cy_, cz_, radius_;
+  std::vector<const ne::abstract::Material *> materials_;
+  uint32_t count_ = 0;
+  Simd simd_;
+
+  inline static constexpr uint32_t padding_ = 16;
+};
+
+} // namespace ne
+
+#endif // __SPHEREPACK_H_
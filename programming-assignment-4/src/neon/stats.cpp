@@ -0,0 +1,117 @@
+#include "neon/stats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+
+namespace ne {
+
+namespace stats {
+
+namespace {
+
+// counters of every thread that ever counted, a deque keeps them in place
+struct Registry {
+  std::mutex mutex;
+  std::deque<Counters> threads;
+};
+
+Registry &registry() {
+  static Registry r;
+  return r;
+}
+
+} // namespace
+
+const char *name(Counter counter) {
+  static const char *const names[numCounters] = {
+      "camera rays",         "bounce rays",          "shadow rays",
+      "node visits",         "primitive tests",      "lambertian",
+      "metal",               "dielectric",           "diffuse light",
+      "custom",              "roulette terminations", "depth terminations"};
+  const size_t i = static_cast<size_t>(counter);
+  return i < numCounters ? names[i] : "?";
+}
+
+#if NE_STATS
+
+namespace detail {
+
+thread_local Counters *counters = nullptr;
+
+Counters *registerThread() {
+  Registry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.threads.emplace_back();
+  counters = &r.threads.back();
+  return counters;
+}
+
+#if defined(_WIN32)
+Counters &local() {
+  Counters *c = counters;
+  return c ? *c : *registerThread();
+}
+#endif
+
+} // namespace detail
+
+#endif // NE_STATS
+
+Counters collect() {
+  Registry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  Counters total;
+  for (const Counters &c : r.threads)
+    total += c;
+  return total;
+}
+
+void reset() {
+  Registry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  std::fill(r.threads.begin(), r.threads.end(), Counters());
+}
+
+void report(std::ostream &out, const Counters &c, double seconds) {
+  const uint64_t camera = c[Counter::CameraRays];
+  const uint64_t bounce = c[Counter::BounceRays];
+  const uint64_t shadow = c[Counter::ShadowRays];
+  const uint64_t rays = camera + bounce + shadow;
+  const double perRay = 1.0 / double(std::max<uint64_t>(rays, 1));
+
+  char line[160];
+  std::snprintf(line, sizeof(line),
+                "rays: %llu camera, %llu bounce, %llu shadow, %.2f Mrays/s "
+                "in %.3f s\n",
+                (unsigned long long)camera, (unsigned long long)bounce,
+                (unsigned long long)shadow,
+                seconds > 0.0 ? rays / seconds * 1e-6 : 0.0, seconds);
+  out << line;
+  std::snprintf(line, sizeof(line),
+                "per ray: %.2f node visits, %.2f primitive tests\n",
+                c[Counter::NodeVisits] * perRay,
+                c[Counter::PrimitiveTests] * perRay);
+  out << line;
+
+  out << "scatter:";
+  for (size_t i = static_cast<size_t>(Counter::ScatterLambertian);
+       i <= static_cast<size_t>(Counter::ScatterCustom); ++i) {
+    std::snprintf(line, sizeof(line), " %llu %s",
+                  (unsigned long long)c.values[i],
+                  name(static_cast<Counter>(i)));
+    out << line << (i < static_cast<size_t>(Counter::ScatterCustom) ? "," : "");
+  }
+  out << "\n";
+
+  std::snprintf(line, sizeof(line),
+                "terminated early: %llu by roulette, %llu at max depth\n",
+                (unsigned long long)c[Counter::RouletteTerminations],
+                (unsigned long long)c[Counter::DepthTerminations]);
+  out << line;
+}
+
+} // namespace stats
+
+} // namespace ne
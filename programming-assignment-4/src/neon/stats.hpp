@@ -0,0 +1,130 @@
+#ifndef __STATS_H_
+#define __STATS_H_
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Render statistics are counted unless the build defines NE_STATS=0
+// (cmake -DNEON_STATS=OFF), which leaves every counting call empty.
+#ifndef NE_STATS
+#define NE_STATS 1
+#endif
+
+namespace ne {
+
+namespace stats {
+
+enum class Counter : uint32_t {
+  CameraRays,
+  BounceRays,
+  ShadowRays,
+  NodeVisits,     // BVH nodes a ray (or packet lane) was tested against
+  PrimitiveTests, // primitives in the leaves a ray reached
+  // scatter calls, in the order of abstract::Material::Kind
+  ScatterLambertian,
+  ScatterMetal,
+  ScatterDielectric,
+  ScatterDiffuseLight,
+  ScatterCustom,
+  RouletteTerminations, // paths killed by Russian roulette
+  DepthTerminations,    // paths that still scattered at the maximum depth
+  Count
+};
+
+constexpr size_t numCounters = static_cast<size_t>(Counter::Count);
+
+const char *name(Counter counter);
+
+// Counters of one thread. Every thread owns a cache line aligned block, so
+// counting never writes to a line another thread counts on.
+struct alignas(64) Counters {
+  uint64_t values[numCounters] = {};
+
+  uint64_t &operator[](Counter c) { return values[static_cast<size_t>(c)]; }
+  uint64_t operator[](Counter c) const {
+    return values[static_cast<size_t>(c)];
+  }
+
+  Counters &operator+=(const Counters &other) {
+    for (size_t i = 0; i < numCounters; ++i)
+      values[i] += other.values[i];
+    return *this;
+  }
+};
+
+/// Sum over all threads that counted so far, including finished ones. Only
+/// exact while no thread is rendering, e.g. after Taskflow::wait_for_all.
+Counters collect();
+
+/// zero the counters of all threads, same restriction as collect()
+void reset();
+
+/// Rays per category and Mrays/s over seconds of rendering, work per ray,
+/// scatter calls per material and path terminations.
+void report(std::ostream &out, const Counters &counters, double seconds);
+
+#if NE_STATS
+
+namespace detail {
+// allocates the counters of the calling thread
+Counters *registerThread();
+#if defined(_WIN32)
+Counters &local(); // thread_local data can not be exported from a DLL
+#else
+#if defined(__GNUC__) || defined(__clang__)
+// neon is linked at startup, the static TLS model saves a call per access
+extern thread_local Counters *counters
+    __attribute__((tls_model("initial-exec")));
+#else
+extern thread_local Counters *counters;
+#endif
+inline Counters &local() {
+  Counters *c = counters;
+  return c ? *c : *registerThread();
+}
+#endif
+} // namespace detail
+
+inline void add(Counter counter, uint64_t n = 1) {
+  detail::local()[counter] += n;
+}
+
+/// Counts into a local and adds the total to the thread's counters when it
+/// goes out of scope, for counts taken inside traversal loops.
+template <Counter C> class Tally {
+public:
+  Tally() = default;
+  Tally(const Tally &) = delete;
+  Tally &operator=(const Tally &) = delete;
+  ~Tally() {
+    if (n_)
+      add(C, n_);
+  }
+
+  void operator+=(uint64_t n) { n_ += n; }
+
+private:
+  uint64_t n_ = 0;
+};
+
+#else
+
+inline void add(Counter, uint64_t = 1) {}
+
+template <Counter C> class Tally {
+public:
+  void operator+=(uint64_t) {}
+};
+
+#endif // NE_STATS
+
+/// lanes set in a packet mask
+inline uint64_t lanes(uint32_t mask) { return std::bitset<32>(mask).count(); }
+
+} // namespace stats
+
+} // namespace ne
+
+#endif // __STATS_H_
@@ -0,0 +1,174 @@
+#include "neon/trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace ne {
+
+namespace trace {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// cache line aligned like stats::Counters, so a thread appending to its
+// events never writes to a line that holds another thread's buffer
+struct alignas(64) ThreadBuffer {
+  uint32_t id = 0;
+  std::string name;
+  std::vector<Event> events;
+};
+
+// buffers of every thread that recorded, a deque keeps them in place
+struct Registry {
+  std::mutex mutex;
+  std::deque<ThreadBuffer> threads;
+};
+
+Registry &registry() {
+  static Registry r;
+  return r;
+}
+
+std::atomic<bool> enabled_{false};
+std::atomic<Clock::rep> epoch_{0};
+thread_local ThreadBuffer *buffer_ = nullptr;
+
+ThreadBuffer &local() {
+  if (!buffer_) {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.threads.emplace_back();
+    buffer_ = &r.threads.back();
+    buffer_->id = static_cast<uint32_t>(r.threads.size());
+    buffer_->name = "thread " + std::to_string(buffer_->id);
+    // tiles of a render pass run to thousands of events
+    buffer_->events.reserve(4096);
+  }
+  return *buffer_;
+}
+
+// names are literals of neon and the sandbox, escape anyway
+void writeString(std::ostream &out, const char *s) {
+  out << '"';
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\')
+      out << '\\';
+    if (static_cast<unsigned char>(*s) >= 0x20)
+      out << *s;
+  }
+  out << '"';
+}
+
+} // namespace
+
+void enable() {
+  epoch_ = Clock::now().time_since_epoch().count();
+  enabled_ = true;
+}
+
+bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+uint64_t now() {
+  const Clock::duration since =
+      Clock::now().time_since_epoch() -
+      Clock::duration(epoch_.load(std::memory_order_relaxed));
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(since).count());
+}
+
+void setThreadName(const std::string &name) { local().name = name; }
+
+void record(const Event &event) { local().events.push_back(event); }
+
+size_t size() {
+  Registry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  size_t n = 0;
+  for (const ThreadBuffer &t : r.threads)
+    n += t.events.size();
+  return n;
+}
+
+bool write(const std::string &path) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cout << "Trace write to " << path << " failed" << std::endl;
+    return false;
+  }
+
+  Registry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  char number[64];
+  for (const ThreadBuffer &t : r.threads) {
+    // track name, then complete ("X") events in microseconds
+    out << (first ? "" : ",\n")
+        << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << t.id
+        << ",\"args\":{\"name\":";
+    writeString(out, t.name.c_str());
+    out << "}}";
+    first = false;
+
+    for (const Event &e : t.events) {
+      auto header = [&](const char *phase) {
+        out << ",\n{\"ph\":\"" << phase << "\",\"name\":";
+        writeString(out, e.name);
+        out << ",\"cat\":";
+        writeString(out, e.category);
+        out << ",\"pid\":1,\"tid\":" << t.id;
+      };
+      auto args = [&]() {
+        if (!e.argNames[0])
+          return;
+        out << ",\"args\":{";
+        for (int i = 0; i < 3 && e.argNames[i]; ++i) {
+          out << (i ? "," : "");
+          writeString(out, e.argNames[i]);
+          out << ':' << e.args[i];
+        }
+        out << '}';
+      };
+
+      if (e.asyncId) {
+        // begin and end with the same id and category form one span
+        header("b");
+        std::snprintf(number, sizeof(number), ",\"ts\":%.3f,\"id\":%llu",
+                      e.begin * 1e-3, (unsigned long long)e.asyncId);
+        out << number;
+        args();
+        out << '}';
+        header("e");
+        std::snprintf(number, sizeof(number), ",\"ts\":%.3f,\"id\":%llu}",
+                      e.end * 1e-3, (unsigned long long)e.asyncId);
+        out << number;
+        continue;
+      }
+
+      header("X");
+      std::snprintf(number, sizeof(number), ",\"ts\":%.3f,\"dur\":%.3f",
+                    e.begin * 1e-3, (e.end - e.begin) * 1e-3);
+      out << number;
+      args();
+      out << '}';
+    }
+  }
+  out << "\n]}\n";
+
+  if (!out) {
+    std::cout << "Trace write to " << path << " failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace trace
+
+} // namespace ne
@@ -0,0 +1,88 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <cstdint>
+#include <string>
+
+namespace ne {
+
+// Timeline of what every thread did, written as Chrome trace JSON (open it
+// in chrome://tracing or ui.perfetto.dev). Recording is off until enable()
+// and costs one relaxed load per span while off.
+//
+// Every thread appends to its own buffer, registered on its first event, so
+// recording takes no lock and touches no shared cache line. Buffers are only
+// read by write(), which has to run while no thread records.
+namespace trace {
+
+struct Event {
+  const char *name;     // string literals, they outlive the trace
+  const char *category;
+  uint64_t begin;       // nanoseconds since enable()
+  uint64_t end;
+  // nonzero for spans that begin and end on different threads, drawn as
+  // async events on a row of their own instead of the thread's track
+  uint64_t asyncId = 0;
+  const char *argNames[3] = {nullptr, nullptr, nullptr};
+  int64_t args[3] = {0, 0, 0};
+};
+
+/// start recording, timestamps count from this call
+void enable();
+bool enabled();
+
+/// nanoseconds since enable()
+uint64_t now();
+
+/// name of the calling thread's track, e.g. "main" or "checkpoint"
+void setThreadName(const std::string &name);
+
+/// append a finished span to the calling thread's buffer
+void record(const Event &event);
+
+/// Write all threads' events as Chrome trace JSON. Returns false and prints
+/// why if the file can not be written.
+bool write(const std::string &path);
+
+/// number of events recorded so far
+size_t size();
+
+/// Records the span from construction to destruction on the calling
+/// thread, with up to three integer arguments.
+class Scope {
+public:
+  Scope(const char *name, const char *category) : active_(enabled()) {
+    if (active_) {
+      event_.name = name;
+      event_.category = category;
+      event_.begin = now();
+    }
+  }
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+  ~Scope() {
+    if (active_) {
+      event_.end = now();
+      record(event_);
+    }
+  }
+
+  Scope &arg(const char *name, int64_t value) {
+    if (active_ && numArgs_ < 3) {
+      event_.argNames[numArgs_] = name;
+      event_.args[numArgs_++] = value;
+    }
+    return *this;
+  }
+
+private:
+  bool active_;
+  int numArgs_ = 0;
+  Event event_{nullptr, nullptr, 0, 0};
+};
+
+} // namespace trace
+
+} // namespace ne
+
+#endif // __TRACE_H_
@@ -0,0 +1,470 @@
+#include "neon/trianglemesh.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <tinyobjloader/tiny_obj_loader.h>
+#include <unordered_map>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) ||            \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NE_SIMD_X86 1
+#include <emmintrin.h>
+#endif
+
+namespace ne {
+
+ne::AABB MeshData::bounds() const {
+  ne::AABB box;
+  for (const glm::vec3 &p : positions)
+    box.expand(p);
+  return box;
+}
+
+void MeshData::transform(const glm::mat4 &m) {
+  for (glm::vec3 &p : positions)
+    p = glm::vec3(m * glm::vec4(p, 1.0f));
+  const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(m)));
+  for (glm::vec3 &n : normals)
+    n = glm::normalize(normalMatrix * n);
+}
+
+void MeshData::computeNormals() {
+  normals.assign(positions.size(), glm::vec3(0.0f));
+  for (const glm::uvec3 &tri : triangles) {
+    // unnormalized cross product weights by area
+    const glm::vec3 n = glm::cross(positions[tri.y] - positions[tri.x],
+                                   positions[tri.z] - positions[tri.x]);
+    normals[tri.x] += n;
+    normals[tri.y] += n;
+    normals[tri.z] += n;
+  }
+  for (glm::vec3 &n : normals) {
+    const float length = glm::length(n);
+    n = length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+  }
+}
+
+const MeshData::Accelerator &MeshData::accelerator() const {
+  std::call_once(built_, [this]() {
+    std::vector<ne::AABB> bounds(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+      bounds[i].expand(positions[triangles[i].x]);
+      bounds[i].expand(positions[triangles[i].y]);
+      bounds[i].expand(positions[triangles[i].z]);
+    }
+    accelerator_.bvh.build(bounds, leafSize);
+
+    // corners in leaf order, padded with degenerate triangles so the last
+    // leaf can load a full SSE register
+    const std::vector<uint32_t> &order = accelerator_.bvh.indices();
+    for (std::vector<float> &a : accelerator_.corners)
+      a.assign(order.size() + leafSize - 1, 0.0f);
+    for (size_t i = 0; i < order.size(); ++i) {
+      const glm::uvec3 &tri = triangles[order[i]];
+      for (int k = 0; k < 3; ++k) {
+        const glm::vec3 &v = positions[tri[k]];
+        accelerator_.corners[3 * k + 0][i] = v.x;
+        accelerator_.corners[3 * k + 1][i] = v.y;
+        accelerator_.corners[3 * k + 2][i] = v.z;
+      }
+    }
+  });
+  return accelerator_;
+}
+
+std::shared_ptr<ne::MeshData> loadObj(const std::string &filename) {
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string warn, err;
+
+  // .mtl files are looked up next to the .obj
+  const size_t slash = filename.find_last_of("/\\");
+  const std::string baseDir =
+      slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+
+  if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
+                        filename.c_str(),
+                        baseDir.empty() ? nullptr : baseDir.c_str())) {
+    std::cout << "OBJ loading error " << filename << ": " << err << std::endl;
+    return nullptr;
+  }
+  if (!warn.empty())
+    std::cout << "OBJ loading warning " << filename << ": " << warn
+              << std::endl;
+
+  // normals are only used when every corner has one
+  bool hasNormals = !attrib.normals.empty();
+  for (const tinyobj::shape_t &shape : shapes)
+    for (const tinyobj::index_t &index : shape.mesh.indices)
+      hasNormals = hasNormals && index.normal_index >= 0;
+
+  auto mesh = std::make_shared<ne::MeshData>();
+  auto position = [&](int v) {
+    return glm::vec3(attrib.vertices[3 * v + 0], attrib.vertices[3 * v + 1],
+                     attrib.vertices[3 * v + 2]);
+  };
+
+  if (!hasNormals) {
+    // positions can be taken over as they are
+    mesh->positions.resize(attrib.vertices.size() / 3);
+    for (size_t v = 0; v < mesh->positions.size(); ++v)
+      mesh->positions[v] = position(static_cast<int>(v));
+  }
+
+  // OBJ indexes positions and normals separately, split vertices that are
+  // shared with different normals
+  std::unordered_map<uint64_t, uint32_t> vertexIndex;
+  auto vertex = [&](const tinyobj::index_t &index) -> uint32_t {
+    if (!hasNormals)
+      return static_cast<uint32_t>(index.vertex_index);
+    const uint64_t key = (uint64_t(uint32_t(index.vertex_index)) << 32) |
+                         uint32_t(index.normal_index);
+    auto it = vertexIndex.find(key);
+    if (it != vertexIndex.end())
+      return it->second;
+    const uint32_t v = static_cast<uint32_t>(mesh->positions.size());
+    const int n = index.normal_index;
+    mesh->positions.push_back(position(index.vertex_index));
+    mesh->normals.push_back(glm::normalize(
+        glm::vec3(attrib.normals[3 * n + 0], attrib.normals[3 * n + 1],
+                  attrib.normals[3 * n + 2])));
+    vertexIndex.emplace(key, v);
+    return v;
+  };
+
+  for (const tinyobj::shape_t &shape : shapes) {
+    // LoadObj triangulates, so every face has three corners
+    const std::vector<tinyobj::index_t> &indices = shape.mesh.indices;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+      mesh->triangles.emplace_back(vertex(indices[i]), vertex(indices[i + 1]),
+                                   vertex(indices[i + 2]));
+  }
+  return mesh;
+}
+
+namespace {
+
+constexpr float eps = ne::abstract::Rendable::eps_;
+
+// Ray transformed for the watertight test: the dominant axis of the direction
+// becomes z, and the shear (sx, sy) maps the direction onto (0, 0, 1).
+struct WatertightRay {
+  int kx, ky, kz;
+  float sx, sy, sz;
+  float ox, oy, oz;
+};
+
+WatertightRay prepare(const ne::Ray &ray) {
+  const glm::vec3 a = glm::abs(ray.dir);
+  WatertightRay r;
+  r.kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+  r.kx = (r.kz + 1) % 3;
+  r.ky = (r.kx + 1) % 3;
+  // keep the winding of the triangles
+  if (ray.dir[r.kz] < 0.0f)
+    std::swap(r.kx, r.ky);
+  r.sx = ray.dir[r.kx] / ray.dir[r.kz];
+  r.sy = ray.dir[r.ky] / ray.dir[r.kz];
+  r.sz = 1.0f / ray.dir[r.kz];
+  r.ox = ray.o[r.kx];
+  r.oy = ray.o[r.ky];
+  r.oz = ray.o[r.kz];
+  return r;
+}
+
+// corner arrays of one mesh, already permuted into the ray's axes
+struct Corners {
+  const float *x[3], *y[3], *z[3];
+};
+
+Corners select(const std::vector<float> (&corners)[9],
+               const WatertightRay &r) {
+  Corners c;
+  for (int k = 0; k < 3; ++k) {
+    c.x[k] = corners[3 * k + r.kx].data();
+    c.y[k] = corners[3 * k + r.ky].data();
+    c.z[k] = corners[3 * k + r.kz].data();
+  }
+  return c;
+}
+
+// Tests the triangles in slots [first, first + count). Returns the slot of
+// the closest hit with distance in (eps, tHit], updating tHit and the
+// barycentric coordinates of the three corners, or -1. In any hit mode it
+// returns the first slot hit.
+int intersectScalar(const Corners &c, uint32_t first, uint32_t count,
+                    const WatertightRay &r, float &tHit, glm::vec3 &bary,
+                    bool anyHit) {
+  int best = -1;
+  for (uint32_t i = first; i < first + count; ++i) {
+    // corners relative to the origin, sheared and scaled
+    const float az = c.z[0][i] - r.oz;
+    const float bz = c.z[1][i] - r.oz;
+    const float cz = c.z[2][i] - r.oz;
+    const float ax = (c.x[0][i] - r.ox) - r.sx * az;
+    const float ay = (c.y[0][i] - r.oy) - r.sy * az;
+    const float bx = (c.x[1][i] - r.ox) - r.sx * bz;
+    const float by = (c.y[1][i] - r.oy) - r.sy * bz;
+    const float cx = (c.x[2][i] - r.ox) - r.sx * cz;
+    const float cy = (c.y[2][i] - r.oy) - r.sy * cz;
+
+    // scaled barycentric coordinates
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+
+    // exactly on an edge, decide in double precision
+    if (u == 0.0f || v == 0.0f || w == 0.0f) {
+      u = static_cast<float>(double(cx) * by - double(cy) * bx);
+      v = static_cast<float>(double(ax) * cy - double(ay) * cx);
+      w = static_cast<float>(double(bx) * ay - double(by) * ax);
+    }
+
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) &&
+        (u > 0.0f || v > 0.0f || w > 0.0f))
+      continue;
+    const float det = u + v + w;
+    if (det == 0.0f)
+      continue;
+
+    // distance scaled by det, compared without dividing
+    const float t = u * (r.sz * az) + v * (r.sz * bz) + w * (r.sz * cz);
+    const float sign = det < 0.0f ? -1.0f : 1.0f;
+    const float tScaled = t * sign;
+    const float detAbs = det * sign;
+    if (tScaled <= eps * detAbs || tScaled > tHit * detAbs)
+      continue;
+
+    if (anyHit)
+      return static_cast<int>(i);
+    const float invDet = 1.0f / det;
+    tHit = t * invDet;
+    bary = glm::vec3(u, v, w) * invDet;
+    best = static_cast<int>(i);
+  }
+  return best;
+}
+
+#ifdef NE_SIMD_X86
+
+// Same test for up to four triangles at once. Falls back to the scalar code
+// when a lane lies exactly on an edge and needs the double precision path.
+int intersectSSE(const Corners &c, uint32_t first, uint32_t count,
+                 const WatertightRay &r, float &tHit, glm::vec3 &bary,
+                 bool anyHit) {
+  const __m128 valid = _mm_castsi128_ps(_mm_cmplt_epi32(
+      _mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(static_cast<int>(count))));
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 ox = _mm_set1_ps(r.ox), oy = _mm_set1_ps(r.oy),
+               oz = _mm_set1_ps(r.oz);
+  const __m128 sx = _mm_set1_ps(r.sx), sy = _mm_set1_ps(r.sy),
+               sz = _mm_set1_ps(r.sz);
+
+  const __m128 az = _mm_sub_ps(_mm_loadu_ps(c.z[0] + first), oz);
+  const __m128 bz = _mm_sub_ps(_mm_loadu_ps(c.z[1] + first), oz);
+  const __m128 cz = _mm_sub_ps(_mm_loadu_ps(c.z[2] + first), oz);
+  const __m128 ax = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(c.x[0] + first), ox),
+                               _mm_mul_ps(sx, az));
+  const __m128 ay = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(c.y[0] + first), oy),
+                               _mm_mul_ps(sy, az));
+  const __m128 bx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(c.x[1] + first), ox),
+                               _mm_mul_ps(sx, bz));
+  const __m128 by = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(c.y[1] + first), oy),
+                               _mm_mul_ps(sy, bz));
+  const __m128 cx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(c.x[2] + first), ox),
+                               _mm_mul_ps(sx, cz));
+  const __m128 cy = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(c.y[2] + first), oy),
+                               _mm_mul_ps(sy, cz));
+
+  const __m128 u = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+  const __m128 v = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+  const __m128 w = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+
+  const __m128 onEdge =
+      _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(u, zero), _mm_cmpeq_ps(v, zero)),
+                _mm_cmpeq_ps(w, zero));
+  if (_mm_movemask_ps(_mm_and_ps(onEdge, valid)))
+    return intersectScalar(c, first, count, r, tHit, bary, anyHit);
+
+  const __m128 negative =
+      _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)),
+                _mm_cmplt_ps(w, zero));
+  const __m128 positive =
+      _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)),
+                _mm_cmpgt_ps(w, zero));
+  const __m128 det = _mm_add_ps(_mm_add_ps(u, v), w);
+  __m128 mask = _mm_andnot_ps(_mm_and_ps(negative, positive), valid);
+  mask = _mm_and_ps(mask, _mm_cmpneq_ps(det, zero));
+
+  const __m128 t = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(u, _mm_mul_ps(sz, az)),
+                 _mm_mul_ps(v, _mm_mul_ps(sz, bz))),
+      _mm_mul_ps(w, _mm_mul_ps(sz, cz)));
+  const __m128 signBit = _mm_and_ps(det, _mm_set1_ps(-0.0f));
+  const __m128 tScaled = _mm_xor_ps(t, signBit);
+  const __m128 detAbs = _mm_xor_ps(det, signBit);
+  mask = _mm_and_ps(mask,
+                    _mm_cmpgt_ps(tScaled, _mm_mul_ps(_mm_set1_ps(eps), detAbs)));
+  mask = _mm_and_ps(
+      mask, _mm_cmple_ps(tScaled, _mm_mul_ps(_mm_set1_ps(tHit), detAbs)));
+
+  int bits = _mm_movemask_ps(mask);
+  if (!bits)
+    return -1;
+
+  alignas(16) float ts[4], us[4], vs[4], ws[4];
+  _mm_store_ps(ts, t);
+  _mm_store_ps(us, u);
+  _mm_store_ps(vs, v);
+  _mm_store_ps(ws, w);
+  alignas(16) float dets[4];
+  _mm_store_ps(dets, det);
+
+  int best = -1;
+  float bestT = tHit;
+  for (int lane = 0; lane < 4; ++lane) {
+    if (!(bits & (1 << lane)))
+      continue;
+    if (anyHit)
+      return static_cast<int>(first) + lane;
+    const float invDet = 1.0f / dets[lane];
+    const float tLane = ts[lane] * invDet;
+    if (best < 0 || tLane < bestT) {
+      best = lane;
+      bestT = tLane;
+      bary = glm::vec3(us[lane], vs[lane], ws[lane]) * invDet;
+    }
+  }
+  tHit = bestT;
+  return static_cast<int>(first) + best;
+}
+
+#endif
+
+inline int intersectLeaf(const Corners &c, uint32_t first, uint32_t count,
+                         const WatertightRay &r, float &tHit, glm::vec3 &bary,
+                         bool anyHit) {
+#ifdef NE_SIMD_X86
+  // leaves have up to four triangles, except those the BVH builder forces at
+  // its depth limit. tHit shrinks from one group to the next.
+  int best = -1;
+  for (uint32_t i = 0; i < count; i += 4) {
+    const int slot = intersectSSE(c, first + i, std::min(count - i, 4u), r,
+                                  tHit, bary, anyHit);
+    if (slot >= 0) {
+      best = slot;
+      if (anyHit)
+        break;
+    }
+  }
+  return best;
+#else
+  return intersectScalar(c, first, count, r, tHit, bary, anyHit);
+#endif
+}
+
+} // namespace
+
+TriangleMesh::TriangleMesh(std::shared_ptr<const ne::MeshData> data,
+                           MaterialPointer m, bool smoothNormals)
+    : ne::abstract::Rendable(m), data_(std::move(data)),
+      accelerator_(data_->accelerator()), smooth_(smoothNormals) {
+  // the root box, unless there are no triangles
+  if (!accelerator_.bvh.empty())
+    bounds_ = accelerator_.bvh.nodes()[0].bounds;
+}
+
+bool TriangleMesh::rayIntersect(ne::Ray &ray, ne::Intersection &hit) {
+  const WatertightRay r = prepare(ray);
+  const Corners c = select(accelerator_.corners, r);
+
+  int slot = -1;
+  glm::vec3 bary;
+  accelerator_.bvh.intersect(
+      ray, [&](uint32_t first, uint32_t count, ne::Ray &current) {
+        const int s =
+            intersectLeaf(c, first, count, r, current.t, bary, false);
+        if (s < 0)
+          return false;
+        slot = s;
+        return true;
+      });
+  if (slot < 0)
+    return false;
+
+  // shading data only for the closest hit
+  shade(ray, slot, bary, hit);
+  return true;
+}
+
+uint32_t TriangleMesh::intersectPacket(ne::RayPacket &packet, uint32_t mask,
+                                       ne::Intersection *hits) {
+  constexpr int width = ne::RayPacket::width;
+  WatertightRay r[width];
+  Corners c[width];
+  int slot[width];
+  glm::vec3 bary[width];
+  for (int i = 0; i < width; ++i) {
+    if (!(mask & (1u << i)))
+      continue;
+    r[i] = prepare(packet.rays[i]);
+    c[i] = select(accelerator_.corners, r[i]);
+    slot[i] = -1;
+  }
+
+  const uint32_t found = accelerator_.bvh.intersect(
+      packet, mask,
+      [&](uint32_t first, uint32_t count, ne::RayPacket &p, uint32_t lanes) {
+        uint32_t hit = 0;
+        for (int i = 0; i < width; ++i) {
+          if (!(lanes & (1u << i)))
+            continue;
+          const int s = intersectLeaf(c[i], first, count, r[i], p.rays[i].t,
+                                      bary[i], false);
+          if (s >= 0) {
+            slot[i] = s;
+            p.updateT(i);
+            hit |= 1u << i;
+          }
+        }
+        return hit;
+      });
+
+  for (int i = 0; i < width; ++i)
+    if (found & (1u << i))
+      shade(packet.rays[i], slot[i], bary[i], hits[i]);
+  return found;
+}
+
+void TriangleMesh::shade(const ne::Ray &ray, int slot, const glm::vec3 &bary,
+                         ne::Intersection &hit) const {
+  const glm::uvec3 &tri = data_->triangles[accelerator_.bvh.indices()[slot]];
+  const std::vector<glm::vec3> &p = data_->positions;
+  glm::vec3 n = glm::cross(p[tri.y] - p[tri.x], p[tri.z] - p[tri.x]);
+  if (smooth_ && !data_->normals.empty()) {
+    const std::vector<glm::vec3> &normals = data_->normals;
+    const glm::vec3 shading = bary.x * normals[tri.x] +
+                              bary.y * normals[tri.y] +
+                              bary.z * normals[tri.z];
+    if (glm::dot(shading, shading) > 0.0f)
+      n = shading;
+  }
+
+  hit.p = ray.at(ray.t);
+  hit.n = glm::normalize(n);
+  hit.material = material_.get();
+}
+
+bool TriangleMesh::occluded(const ne::Ray &ray) {
+  const WatertightRay r = prepare(ray);
+  const Corners c = select(accelerator_.corners, r);
+  return accelerator_.bvh.occluded(
+      ray, [&](uint32_t first, uint32_t count, const ne::Ray &segment) {
+        float tHit = segment.t;
+        glm::vec3 bary;
+        return intersectLeaf(c, first, count, r, tHit, bary, true) >= 0;
+      });
+}
+
+} // namespace ne
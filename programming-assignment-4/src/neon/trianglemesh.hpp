@@ -0,0 +1,88 @@
+#ifndef __TRIANGLEMESH_H_
+#define __TRIANGLEMESH_H_
+
+#include "neon/aabb.hpp"
+#include "neon/bvh.hpp"
+#include "neon/rendable.hpp"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ne {
+
+// Indexed triangle soup. Several TriangleMesh objects can share one MeshData,
+// and with it the BVH and the corner copy they trace.
+struct MeshData {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals; // per vertex, empty for flat shading
+  std::vector<glm::uvec3> triangles;
+
+  // BVH over the triangles and a copy of their corners in BVH leaf order as
+  // structure of arrays: corner c, axis a of the triangle in slot i is
+  // corners[3 * c + a][i], padded so a leaf can always load four lanes
+  struct Accelerator {
+    ne::BVH bvh;
+    std::vector<float> corners[9];
+  };
+
+  ne::AABB bounds() const;
+
+  /// apply an affine transform to positions and normals
+  void transform(const glm::mat4 &m);
+
+  /// area weighted vertex normals, replaces existing ones
+  void computeNormals();
+
+  /// Built by the first call, usually from the first TriangleMesh made of
+  /// this data. Positions and triangles must not change afterwards.
+  const Accelerator &accelerator() const;
+
+  inline static constexpr uint32_t leafSize = 4;
+
+private:
+  mutable std::once_flag built_;
+  mutable Accelerator accelerator_;
+};
+
+/// Load all shapes of an OBJ file into one mesh. Polygons are triangulated,
+/// vertices with different normals are split. Returns nullptr on error.
+std::shared_ptr<ne::MeshData> loadObj(const std::string &filename);
+
+// Rendable triangle mesh. Triangles are not objects; the mesh traces the BVH
+// and leaf ordered corners of its MeshData, so a leaf of up to four triangles
+// is tested with one SSE kernel. The test is the watertight algorithm of
+// Woop, Benthin and Wald (JCGT 2013): rays never slip through shared edges or
+// vertices.
+class TriangleMesh : public abstract::Rendable {
+public:
+  TriangleMesh(std::shared_ptr<const ne::MeshData> data, MaterialPointer m,
+               bool smoothNormals = true);
+
+  bool rayIntersect(ne::Ray &ray, ne::Intersection &hit) override;
+  bool occluded(const ne::Ray &ray) override;
+  uint32_t intersectPacket(ne::RayPacket &packet, uint32_t mask,
+                           ne::Intersection *hits) override;
+  ne::AABB bounds() const override { return bounds_; }
+
+  const ne::MeshData &data() const { return *data_; }
+  size_t numTriangles() const { return data_->triangles.size(); }
+  const ne::BVH &bvh() const { return accelerator_.bvh; }
+
+private:
+  /// fill hit for the closest triangle, in BVH slot order
+  void shade(const ne::Ray &ray, int slot, const glm::vec3 &bary,
+             ne::Intersection &hit) const;
+
+  std::shared_ptr<const ne::MeshData> data_;
+  const ne::MeshData::Accelerator &accelerator_;
+  bool smooth_;
+  ne::AABB bounds_;
+};
+
+} // namespace ne
+
+#endif // __TRIANGLEMESH_H_
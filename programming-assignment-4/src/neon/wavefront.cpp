@@ -0,0 +1,189 @@
+#include "neon/wavefront.hpp"
+#include "neon/camera.hpp"
+#include "neon/material.hpp"
+#include "neon/raypacket.hpp"
+#include "neon/stats.hpp"
+
+#include <algorithm>
+
+namespace ne {
+
+namespace core {
+
+void WavefrontIntegrator::render(const ne::Scene &scene,
+                                 const ne::Camera &camera,
+                                 const ne::TileIterator &tile,
+                                 glm::uvec2 imageSize, int firstSample,
+                                 int numSamples, uint64_t seed,
+                                 std::vector<glm::vec3> &radiance,
+                                 std::vector<FirstHit> *firstHits) {
+  std::vector<glm::uvec2> pixels;
+  for (auto &index : tile)
+    pixels.push_back(index);
+  if (pixels.empty() || numSamples <= 0) {
+    radiance.clear();
+    return;
+  }
+
+  sum_.assign(pixels.size(), glm::vec3(0.0f));
+  if (firstHits)
+    firstHitSum_.assign(pixels.size(), {glm::vec3(0.0f), glm::vec3(0.0f)});
+  else
+    firstHitSum_.clear();
+
+  // as many samples per pixel as fit into one queue
+  const uint32_t numPixels = static_cast<uint32_t>(pixels.size());
+  const int batch = static_cast<int>(
+      std::max(1u, std::min<uint32_t>(numSamples, queueSize_ / numPixels)));
+
+  const int end = firstSample + numSamples;
+  for (int first = firstSample; first < end; first += batch) {
+    generate(camera, pixels, imageSize, first, std::min(batch, end - first),
+             seed);
+    for (bool primary = true; !paths_.empty(); primary = false) {
+      extend(scene, primary);
+      shade(scene);
+      shadow(scene);
+      paths_.swap(next_);
+      next_.clear();
+    }
+  }
+
+  accumulate(numSamples, radiance, firstHits);
+}
+
+void WavefrontIntegrator::generate(const ne::Camera &camera,
+                                   const std::vector<glm::uvec2> &pixels,
+                                   glm::uvec2 imageSize, int firstSample,
+                                   int numSamples, uint64_t seed) {
+  paths_.clear();
+  for (int s = firstSample; s < firstSample + numSamples; ++s) {
+    for (uint32_t p = 0; p < pixels.size(); ++p) {
+      const glm::uvec2 index = pixels[p];
+      // one stream per pixel sample, independent of batching and scheduling
+      const uint64_t pixelIndex = index.x + uint64_t(index.y) * imageSize.x;
+      ne::Sampler sampler(seed, (pixelIndex << 32) | uint32_t(s));
+
+      const float u = (float(index.x) + sampler.next1D()) / float(imageSize.x);
+      const float v = (float(index.y) + sampler.next1D()) / float(imageSize.y);
+      paths_.push_back({camera.sample(u, v), glm::vec3(1.0f), sampler, p, 0});
+    }
+  }
+}
+
+void WavefrontIntegrator::extend(const ne::Scene &scene, bool primary) {
+  const size_t n = paths_.size();
+  hits_.resize(n);
+  found_.resize(n);
+  ne::stats::add(primary ? ne::stats::Counter::CameraRays
+                         : ne::stats::Counter::BounceRays,
+                 n);
+  size_t i = 0;
+  if (primary) {
+    // consecutive camera rays belong to neighbouring pixels
+    constexpr int width = ne::RayPacket::width;
+    ne::RayPacket packet;
+    for (; i + width <= n; i += width) {
+      for (int lane = 0; lane < width; ++lane) {
+        packet.rays[lane] = paths_[i + lane].ray;
+        hits_[i + lane] = ne::Intersection();
+      }
+      packet.setup(width);
+      const uint32_t found = scene.rayIntersect(packet, &hits_[i]);
+      for (int lane = 0; lane < width; ++lane) {
+        paths_[i + lane].ray.t = packet.rays[lane].t;
+        found_[i + lane] = (found >> lane) & 1u;
+      }
+    }
+  }
+  for (; i < n; ++i) {
+    hits_[i] = ne::Intersection();
+    found_[i] = scene.rayIntersect(paths_[i].ray, hits_[i]) ? 1 : 0;
+  }
+}
+
+void WavefrontIntegrator::shade(const ne::Scene &scene) {
+  const uint32_t n = static_cast<uint32_t>(paths_.size());
+
+  // counting sort by material kind, so paths running the same scatter code
+  // are shaded together. Bin 0 holds the paths that escaped.
+  constexpr uint32_t numBins =
+      static_cast<uint32_t>(ne::abstract::Material::Kind::Custom) + 2;
+  binKey_.resize(n);
+  binStart_.assign(numBins + 1, 0);
+  for (uint32_t i = 0; i < n; ++i) {
+    binKey_[i] =
+        found_[i] ? static_cast<uint32_t>(hits_[i].material->kind()) + 1 : 0;
+    binStart_[binKey_[i] + 1]++;
+  }
+  for (uint32_t b = 0; b < numBins; ++b)
+    binStart_[b + 1] += binStart_[b];
+  order_.resize(n);
+  for (uint32_t i = 0; i < n; ++i)
+    order_[binStart_[binKey_[i]]++] = i;
+
+  for (uint32_t i : order_) {
+    PathState &path = paths_[i];
+
+    // depth counts the rays traced before this one
+    const int length = path.depth + 1;
+    if (path.depth == 0 && !firstHitSum_.empty())
+      firstHitSum_[path.pixel] += FirstHit::make(found_[i], path.ray, hits_[i]);
+
+    if (!found_[i]) {
+      sum_[path.pixel] +=
+          path.throughput * scene.sampleBackgroundLight(path.ray.dir);
+      statistics_.record(length);
+      continue;
+    }
+
+    const ne::Intersection &hit = hits_[i];
+    const ne::abstract::Material *material = hit.material;
+    ne::Ray scattered;
+    if (!ne::scatter(*material, path.ray, hit, scattered, path.sampler)) {
+      sum_[path.pixel] += path.throughput * ne::emitted(*material);
+      statistics_.record(length);
+      continue;
+    }
+
+    lightSamples_.clear();
+    scene.sampleLights(hit, path.sampler, lightSamples_);
+    for (const ne::LightSample &sample : lightSamples_)
+      shadowRays_.push_back(
+          {hit.p, sample.target, path.throughput * sample.weight, path.pixel});
+
+    glm::vec3 throughput = path.throughput * ne::attenuation(*material);
+    if (length >= settings_.maxDepth) {
+      ne::stats::add(ne::stats::Counter::DepthTerminations);
+      statistics_.record(length);
+    } else if (!russianRoulette(settings_, length, throughput, path.sampler)) {
+      ++statistics_.rouletteTerminated;
+      statistics_.record(length);
+    } else {
+      next_.push_back(
+          {scattered, throughput, path.sampler, path.pixel, path.depth + 1});
+    }
+  }
+}
+
+void WavefrontIntegrator::shadow(const ne::Scene &scene) {
+  for (const ShadowRay &s : shadowRays_) {
+    if (!scene.occluded(s.origin, s.target))
+      sum_[s.pixel] += s.weight;
+  }
+  shadowRays_.clear();
+}
+
+void WavefrontIntegrator::accumulate(int numSamples,
+                                     std::vector<glm::vec3> &radiance,
+                                     std::vector<FirstHit> *firstHits) const {
+  radiance.resize(sum_.size());
+  for (size_t i = 0; i < sum_.size(); ++i)
+    radiance[i] = sum_[i] / float(numSamples);
+  if (firstHits)
+    *firstHits = firstHitSum_;
+}
+
+} // namespace core
+
+} // namespace ne
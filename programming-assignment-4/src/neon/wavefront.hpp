@@ -0,0 +1,101 @@
+#ifndef __WAVEFRONT_H_
+#define __WAVEFRONT_H_
+
+#include "neon/blueprint.hpp"
+#include "neon/image.hpp"
+#include "neon/integrator.hpp"
+#include "neon/intersection.hpp"
+#include "neon/ray.hpp"
+#include "neon/sampler.hpp"
+#include "neon/scene.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ne {
+
+namespace core {
+
+// Breadth first alternative to Integrator. Instead of following one path
+// through all of its bounces, a whole batch of paths of a tile advances one
+// phase at a time:
+//
+//   generate   -> camera rays for every pixel and sample of the batch
+//   extend     -> closest hit for every active path
+//   shade      -> scatter + light sample candidates, by material kind
+//   shadow     -> occlusion test of every light sample of the bounce
+//   accumulate -> averaged radiance of the tile
+//
+// Each phase runs one tight loop over a large queue, so the same code and
+// data stay in cache. It computes the same estimator as Integrator.
+class WavefrontIntegrator {
+public:
+  /// queueSize is the number of paths alive at once, it controls the memory
+  /// used per tile
+  explicit WavefrontIntegrator(
+      const IntegratorSettings &settings = IntegratorSettings(),
+      uint32_t queueSize = 1u << 16)
+      : settings_(settings), queueSize_(queueSize) {}
+
+  /// Render samples [firstSample, firstSample + numSamples) of every pixel of
+  /// the tile, so progressive passes continue where the last one stopped.
+  /// radiance receives the averaged color of each pixel in the iteration
+  /// order of the tile. firstHits, if given, receives the first hits summed
+  /// over the samples, in the same order.
+  void render(const ne::Scene &scene, const ne::Camera &camera,
+              const ne::TileIterator &tile, glm::uvec2 imageSize,
+              int firstSample, int numSamples, uint64_t seed,
+              std::vector<glm::vec3> &radiance,
+              std::vector<FirstHit> *firstHits = nullptr);
+
+  const PathStatistics &statistics() const { return statistics_; }
+
+private:
+  struct PathState {
+    ne::Ray ray;
+    glm::vec3 throughput;
+    ne::Sampler sampler;
+    uint32_t pixel; // index into the tile's radiance buffer
+    int depth;
+  };
+
+  struct ShadowRay {
+    glm::vec3 origin;
+    glm::vec3 target;
+    glm::vec3 weight;
+    uint32_t pixel;
+  };
+
+  void generate(const ne::Camera &camera, const std::vector<glm::uvec2> &pixels,
+                glm::uvec2 imageSize, int firstSample, int numSamples,
+                uint64_t seed);
+  /// primary: paths_ holds camera rays in pixel order, traced as packets
+  void extend(const ne::Scene &scene, bool primary);
+  void shade(const ne::Scene &scene);
+  void shadow(const ne::Scene &scene);
+  void accumulate(int numSamples, std::vector<glm::vec3> &radiance,
+                  std::vector<FirstHit> *firstHits) const;
+
+  IntegratorSettings settings_;
+  PathStatistics statistics_;
+  uint32_t queueSize_;
+
+  // queues, reused between batches and tiles
+  std::vector<PathState> paths_;
+  std::vector<PathState> next_;
+  std::vector<ne::Intersection> hits_;
+  std::vector<uint8_t> found_;
+  std::vector<uint32_t> order_;
+  std::vector<uint32_t> binKey_;
+  std::vector<uint32_t> binStart_;
+  std::vector<ShadowRay> shadowRays_;
+  std::vector<ne::LightSample> lightSamples_;
+  std::vector<glm::vec3> sum_;
+  std::vector<FirstHit> firstHitSum_; // empty unless render() wants them
+};
+
+} // namespace core
+
+} // namespace ne
+
+#endif // __WAVEFRONT_H_